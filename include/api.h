@@ -518,6 +518,11 @@ template <> struct convertible<Vec3> {
                     "Cannot convert to vec3");
     return vector<float>(vec)([](float *el, size_t l) { return *((Vec3 *)el); });
   }
+  static void set_scm(SCM vec, Vec3 const &v) {
+    SCM_ASSERT_TYPE(scm_is_true(scm_f32vector_p(vec)) && scm_to_int(scm_f32vector_length(vec)) == 3, vec, SCM_ARG1, "c:vec3->f32vector!",
+                    "Cannot store vec3");
+    vector<float>(vec) <<= [&](float *el, size_t l) { *((Vec3 *)el) = v; };
+  }
 };
 
 template <> struct convertible<BlockPos> {
@@ -531,6 +536,11 @@ template <> struct convertible<BlockPos> {
                     "Cannot convert to BlockPos");
     return vector<int>(vec)([](int *el, size_t l) { return *((BlockPos *)el); });
   }
+  static void set_scm(SCM vec, BlockPos const &v) {
+    SCM_ASSERT_TYPE(scm_is_true(scm_s32vector_p(vec)) && scm_to_int(scm_s32vector_length(vec)) == 3, vec, 0, "c:blockpos->s32vector!",
+                    "Cannot store BlockPos");
+    vector<int>(vec) <<= [&](int *el, size_t l) { *((BlockPos *)el) = v; };
+  }
 };
 
 struct dynwind : private boost::noncopyable {
@@ -173,8 +173,8 @@ struct ExtendedCertificate {
 struct Player : Mob {
   void remove();
   Certificate &getCertificate() const;
-  mce::UUID &getUUID() const;  // requires bridge
-  std::string getXUID() const; // requires bridge
+  mce::UUID &getUUID() const;  // requires support
+  std::string getXUID() const; // requires support
   NetworkIdentifier const &getClientId() const;
   unsigned char getClientSubId() const;
   BlockPos getSpawnPosition();
@@ -317,4 +317,21 @@ struct ItemUseCallback;
 extern void onPlayerJoined(std::function<void(ServerPlayer &player)> callback);
 extern void onPlayerLeft(std::function<void(ServerPlayer &player)> callback);
 
+struct PlayerEntry {
+  ServerPlayer *player;
+  NetworkIdentifier clientId;
+  mce::UUID uuid;
+  std::string name, uuidString, xuid;
+};
+
+using PlayerList = std::vector<PlayerEntry>;
+
+// Immutable snapshot maintained by the join/leave hooks, safe to read from any thread
+extern std::shared_ptr<PlayerList const> getPlayerList();
+
+// Server thread only, nullptr when the player is not online
+extern ServerPlayer *findPlayerByUUID(mce::UUID const &uuid);
+extern ServerPlayer *findPlayerByXUID(std::string const &xuid);
+extern ServerPlayer *findPlayerByName(std::string const &name);
+
 extern void kickPlayer(ServerPlayer *player);
\ No newline at end of file
@@ -60,10 +60,8 @@ static int method_list(sd_bus_message *call, void *userdata, sd_bus_error *ret_e
   sd_bus_message *m;
   sd_bus_message_new_method_return(call, &m);
   sd_bus_message_open_container(m, 'a', "(sss)");
-  ServerCommand::mGame->getLevel().forEachPlayer([&](Player &p) -> bool {
-    sd_bus_message_append(m, "(sss)", p.getNameTag().c_str(), p.getUUID().asString().c_str(), p.getXUID().c_str());
-    return true;
-  });
+  for (auto const &entry : *getPlayerList())
+    sd_bus_message_append(m, "(sss)", entry.name.c_str(), entry.uuidString.c_str(), entry.xuid.c_str());
   sd_bus_message_close_container(m);
   auto ret = sd_bus_send(bus, m, nullptr);
   sd_bus_message_unrefp(&m);
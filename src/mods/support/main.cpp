@@ -5,12 +5,49 @@
 
 #include <base.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+
 std::vector<std::function<void(ServerPlayer &)>> joinedHandles, leftsHandles;
 
+static std::shared_ptr<PlayerList const> playerList = std::make_shared<PlayerList const>();
+
+// Copy-on-write: joins and leaves are rare, readers (D-Bus, scripts) are not
+template <typename F> static void updatePlayerList(F f) {
+  auto next = std::make_shared<PlayerList>(*std::atomic_load(&playerList));
+  f(*next);
+  std::atomic_store(&playerList, std::shared_ptr<PlayerList const>(std::move(next)));
+}
+
+std::shared_ptr<PlayerList const> getPlayerList() { return std::atomic_load(&playerList); }
+
+static std::unordered_map<mce::UUID, ServerPlayer *> uuidIndex;
+static std::unordered_map<std::string, ServerPlayer *> xuidIndex, nameIndex;
+
+static std::string lowerName(std::string name) {
+  std::transform(name.begin(), name.end(), name.begin(), [](unsigned char ch) { return std::tolower(ch); });
+  return name;
+}
+
+template <typename K, typename M> static ServerPlayer *findIn(M const &map, K const &key) {
+  auto it = map.find(key);
+  return it != map.end() ? it->second : nullptr;
+}
+
+ServerPlayer *findPlayerByUUID(mce::UUID const &uuid) { return findIn(uuidIndex, uuid); }
+ServerPlayer *findPlayerByXUID(std::string const &xuid) { return findIn(xuidIndex, xuid); }
+ServerPlayer *findPlayerByName(std::string const &name) { return findIn(nameIndex, lowerName(name)); }
+
 struct ConnectionRequest {};
 
 TInstanceHook(void, _ZN20ServerNetworkHandler24onReady_ClientGenerationER6PlayerRK17NetworkIdentifier, ServerNetworkHandler, ServerPlayer &player,
               NetworkIdentifier const &nid) {
+  PlayerEntry entry{ &player, player.getClientId(), player.getUUID(), player.getNameTag(), player.getUUID().asString(), player.getXUID() };
+  uuidIndex[entry.uuid]            = &player;
+  xuidIndex[entry.xuid]            = &player;
+  nameIndex[lowerName(entry.name)] = &player;
+  updatePlayerList([&](PlayerList &list) { list.push_back(std::move(entry)); });
   for (auto joined : joinedHandles) {
     joined(player);
   }
@@ -23,6 +60,14 @@ void kickPlayer(ServerPlayer *player) {
 
   if (player != nullptr) {
     for (auto left : leftsHandles) left(*player);
+    updatePlayerList([&](PlayerList &list) {
+      auto it = std::find_if(list.begin(), list.end(), [&](PlayerEntry const &entry) { return entry.player == player; });
+      if (it == list.end()) return;
+      if (findIn(uuidIndex, it->uuid) == player) uuidIndex.erase(it->uuid);
+      if (findIn(xuidIndex, it->xuid) == player) xuidIndex.erase(it->xuid);
+      if (auto name = lowerName(it->name); findIn(nameIndex, name) == player) nameIndex.erase(name);
+      list.erase(it);
+    });
   }
 }
 
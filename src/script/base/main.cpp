@@ -6,6 +6,7 @@ MAKE_FOREIGN_TYPE(Actor *, "actor");
 MAKE_FOREIGN_TYPE(ItemActor *, "item-actor");
 MAKE_FOREIGN_TYPE(ServerPlayer *, "player");
 MAKE_FOREIGN_TYPE(ItemInstance *, "item-instance");
+MAKE_FOREIGN_TYPE(Item *, "item");
 
 extern "C" Minecraft *support_get_minecraft();
 
@@ -44,6 +45,12 @@ SCM_DEFINE_PUBLIC(c_teleport, "teleport", 3, 0, 0, (scm::val<Actor *> actor, scm
 
 SCM_DEFINE_PUBLIC(actor_position, "actor-pos", 1, 0, 0, (scm::val<Actor *> actor), "Get position of actor") { return scm::to_scm(actor->getPos()); }
 
+SCM_DEFINE_PUBLIC(actor_position_fill, "actor-pos!", 2, 0, 0, (scm::val<Actor *> actor, scm::val<Vec3> target),
+                  "Store position of actor into f32vector") {
+  target = actor->getPos();
+  return target.scm;
+}
+
 SCM_DEFINE_PUBLIC(actor_dim, "actor-dim", 1, 0, 0, (scm::val<Actor *> actor), "Get actor dim") { return scm::to_scm(actor->getDimensionId()); }
 
 SCM_DEFINE_PUBLIC(player_spawnpoint, "player-spawnpoint", 1, 0, 0, (scm::val<ServerPlayer *> player), "Get spawnpoint of player") {
@@ -85,10 +92,86 @@ SCM_DEFINE_PUBLIC(c_actor_debug, "actor-debug-info", 1, 0, 0, (scm::val<Actor *>
 SCM_DEFINE_PUBLIC(c_actor_name, "actor-name", 1, 0, 0, (scm::val<Actor *> act), "Return Actor's name") { return scm::to_scm(act->getNameTag()); }
 
 SCM_DEFINE_PUBLIC(c_for_each_player, "for-each-player", 1, 0, 0, (scm::callback<bool, ServerPlayer *> callback), "Invoke function for each player") {
-  support_get_minecraft()->getLevel().forEachPlayer([=](Player &p) { return callback((ServerPlayer *)&p); });
+  auto list = getPlayerList();
+  for (auto const &entry : *list)
+    if (!callback(entry.player)) break;
   return SCM_UNSPECIFIED;
 }
 
+SCM_DEFINE_PUBLIC(c_player_list, "player-list", 0, 0, 0, (), "Get list of online players") {
+  auto list = getPlayerList();
+  SCM ret   = SCM_EOL;
+  for (auto it = list->rbegin(); it != list->rend(); it++) { ret = scm_cons(scm::to_scm(it->player), ret); }
+  return ret;
+}
+
+SCM_DEFINE_PUBLIC(c_player_positions, "player-positions", 0, 1, 0, (SCM target),
+                  "Get positions of all players (in player-list order) packed into one f32vector, reusing target if size matches") {
+  auto list = getPlayerList();
+  auto size = list->size() * 3;
+  scm::vector<float> vec{ target };
+  if (SCM_UNBNDP(target) || !scm_is_true(scm_f32vector_p(target)) || vec.size() != size) vec = scm::vector<float>{ size };
+  vec <<= [&](float *el, size_t l) {
+    for (auto const &entry : *list) {
+      *((Vec3 *)el) = entry.player->getPos();
+      el += 3;
+    }
+  };
+  return vec;
+}
+
+enum QueryField : int { QUERY_POS = 1, QUERY_DIM = 2, QUERY_ROT = 4, QUERY_NAME = 8, QUERY_PLAYER = 16 };
+
+SCM_DEFINE_PUBLIC(c_query_players, "query-players", 1, 0, 0, (scm::val<int> mask),
+                  "Gather selected fields of all players in one pass, returns list of arrays in field order") {
+  auto list   = getPlayerList();
+  auto size   = list->size();
+  int fields  = mask;
+  SCM names   = (fields & QUERY_NAME) ? scm_c_make_vector(size, SCM_BOOL_F) : SCM_BOOL_F;
+  SCM players = (fields & QUERY_PLAYER) ? scm_c_make_vector(size, SCM_BOOL_F) : SCM_BOOL_F;
+  scm::vector<float> pos{ (fields & QUERY_POS) ? size * 3 : 0 };
+  scm::vector<int> dim{ (fields & QUERY_DIM) ? size : 0 };
+  scm::vector<float> rot{ (fields & QUERY_ROT) ? size * 2 : 0 };
+  pos <<= [&](float *p, size_t) {
+    dim <<= [&](int *d, size_t) {
+      rot <<= [&](float *r, size_t) {
+        size_t i = 0;
+        for (auto const &entry : *list) {
+          auto player = entry.player;
+          if (fields & QUERY_POS) *((Vec3 *)(p + i * 3)) = player->getPos();
+          if (fields & QUERY_DIM) d[i] = player->getDimensionId();
+          if (fields & QUERY_ROT) *((Vec2 *)(r + i * 2)) = player->getRotation();
+          if (fields & QUERY_NAME) scm_c_vector_set_x(names, i, scm::to_scm(player->getNameTag()));
+          if (fields & QUERY_PLAYER) scm_c_vector_set_x(players, i, scm::to_scm(player));
+          i++;
+        }
+      };
+    };
+  };
+  SCM ret = SCM_EOL;
+  if (fields & QUERY_PLAYER) ret = scm_cons(players, ret);
+  if (fields & QUERY_NAME) ret = scm_cons(names, ret);
+  if (fields & QUERY_ROT) ret = scm_cons(rot, ret);
+  if (fields & QUERY_DIM) ret = scm_cons(dim, ret);
+  if (fields & QUERY_POS) ret = scm_cons(pos, ret);
+  return ret;
+}
+
+SCM_DEFINE_PUBLIC(c_player_by_uuid, "player-by-uuid", 1, 0, 0, (scm::val<mce::UUID> uuid), "Find online player by UUID") {
+  auto player = findPlayerByUUID(uuid);
+  return player ? scm::to_scm(player) : SCM_BOOL_F;
+}
+
+SCM_DEFINE_PUBLIC(c_player_by_xuid, "player-by-xuid", 1, 0, 0, (scm::val<std::string> xuid), "Find online player by XUID") {
+  auto player = findPlayerByXUID(xuid);
+  return player ? scm::to_scm(player) : SCM_BOOL_F;
+}
+
+SCM_DEFINE_PUBLIC(c_player_by_name, "player-by-name", 1, 0, 0, (scm::val<std::string> name), "Find online player by name (case insensitive)") {
+  auto player = findPlayerByName(name);
+  return player ? scm::to_scm(player) : SCM_BOOL_F;
+}
+
 SCM_DEFINE_PUBLIC(c_player_kick, "player-kick", 1, 0, 0, (scm::val<ServerPlayer *> player), "Kick player from server") {
   kickPlayer(player);
   return SCM_UNSPECIFIED;
@@ -172,9 +255,15 @@ SCM_DEFINE_PUBLIC(item_instance_id, "item-instance-id", 1, 0, 0, (scm::val<ItemI
   return scm::to_scm(instance->getId());
 }
 
-SCM_DEFINE_PUBLIC(item_id_from_string, "lookup-item-id", 1, 0, 0, (scm::val<std::string> name), "Get Item Id from name") {
+SCM_DEFINE_PUBLIC(item_type, "item-type", 1, 0, 0, (scm::val<std::string> name), "Resolve item name to a reusable handle") {
   auto item = ItemRegistry::lookupByName(name, true);
   if (!item) return SCM_BOOL_F;
+  return scm::to_scm(item);
+}
+
+SCM_DEFINE_PUBLIC(item_id_from_string, "lookup-item-id", 1, 0, 0, (SCM name), "Get Item Id from name") {
+  auto item = itemFromScm(name);
+  if (!item) return SCM_BOOL_F;
   return scm::to_scm(item->getId());
 }
 
@@ -211,6 +300,13 @@ PRELOAD_MODULE("minecraft base") {
   scm::definer("*profile*") = mcpelauncher_get_profile();
   scm_c_export("*profile*");
 
+  scm::definer("query-pos")    = (int)QUERY_POS;
+  scm::definer("query-dim")    = (int)QUERY_DIM;
+  scm::definer("query-rot")    = (int)QUERY_ROT;
+  scm::definer("query-name")   = (int)QUERY_NAME;
+  scm::definer("query-player") = (int)QUERY_PLAYER;
+  scm_c_export("query-pos", "query-dim", "query-rot", "query-name", "query-player", nullptr);
+
   onPlayerJoined <<= scm::define_hook<ServerPlayer &>("player-joined");
   onPlayerLeft <<= scm::define_hook<ServerPlayer &>("player-left");
 
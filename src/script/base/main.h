@@ -19,4 +19,11 @@ template <> struct convertible<Actor *> : foreign_object_is_convertible<Actor *>
   }
 };
 template <> struct convertible<ItemInstance *> : foreign_object_is_convertible<ItemInstance *> {};
-} // namespace scm
\ No newline at end of file
+template <> struct convertible<Item *> : foreign_object_is_convertible<Item *> {};
+} // namespace scm
+
+// Item arguments accept a handle from item-type or an item name
+inline Item *itemFromScm(SCM value) {
+  if (SCM_IS_A_P(value, scm::foreign_type_convertible<Item *>::type())) return scm::from_scm<Item *>(value);
+  return ItemRegistry::lookupByName(scm::from_scm<std::string>(value), true);
+}
\ No newline at end of file
@@ -425,6 +425,11 @@ SCM_DEFINE_PUBLIC(orig_pos, "orig-pos", 0, 0, 0, (), "Get CommandOrigin pos") {
   return scm::to_scm(f_current_command_origin()->getWorldPosition());
 }
 
+SCM_DEFINE_PUBLIC(orig_pos_fill, "orig-pos!", 1, 0, 0, (scm::val<Vec3> target), "Store CommandOrigin pos into f32vector") {
+  target = f_current_command_origin()->getWorldPosition();
+  return target.scm;
+}
+
 LOADFILE(preload, "src/script/command/preload.scm");
 
 PRELOAD_MODULE("minecraft command") {
@@ -0,0 +1,123 @@
+// Deps: out/script_cooldown.so: out/script_base.so out/script_tick.so
+#include "../base/main.h"
+#include "../tick/main.h"
+
+#include <api.h>
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+// Keys expire through a hashed timer wheel that is advanced lazily on access,
+// so there is no per-key timer and no per-tick work when nobody asks.
+struct Cooldown {
+  static constexpr size_t slots = 256;
+
+  uint64_t duration;
+  uint64_t swept;
+  std::unordered_map<std::string, uint64_t> deadlines;
+  std::array<std::vector<std::string>, slots> wheel;
+
+  Cooldown(uint64_t duration)
+      : duration(duration)
+      , swept(getCurrentTick()) {}
+
+  void expireSlot(size_t slot, uint64_t now) {
+    auto &bucket = wheel[slot];
+    auto keep    = bucket.begin();
+    for (auto &key : bucket) {
+      auto it = deadlines.find(key);
+      if (it == deadlines.end() || it->second % slots != slot) continue; // removed or rescheduled
+      if (it->second <= now) {
+        deadlines.erase(it);
+        continue;
+      }
+      if (&*keep != &key) *keep = std::move(key); // due in a later lap
+      ++keep;
+    }
+    bucket.erase(keep, bucket.end());
+  }
+
+  void advance(uint64_t now) {
+    if (now <= swept) return;
+    if (now - swept >= slots) {
+      for (size_t slot = 0; slot < slots; slot++) expireSlot(slot, now);
+    } else {
+      for (auto t = swept + 1; t <= now; t++) expireSlot(t % slots, now);
+    }
+    swept = now;
+  }
+
+  uint64_t remaining(std::string const &key) {
+    auto now = getCurrentTick();
+    advance(now);
+    auto it = deadlines.find(key);
+    if (it == deadlines.end() || it->second <= now) return 0;
+    return it->second - now;
+  }
+
+  void set(std::string const &key, uint64_t length) {
+    auto now = getCurrentTick();
+    advance(now);
+    auto deadline  = now + length;
+    deadlines[key] = deadline;
+    wheel[deadline % slots].push_back(key);
+  }
+
+  bool checkAndSet(std::string const &key, uint64_t length) {
+    if (remaining(key) > 0) return false;
+    set(key, length);
+    return true;
+  }
+
+  void clear(std::string const &key) { deadlines.erase(key); }
+};
+
+namespace scm {
+template <> struct convertible<Cooldown *> : foreign_object_is_convertible<Cooldown *> {};
+} // namespace scm
+
+MAKE_FOREIGN_TYPE(Cooldown *, "cooldown", [](SCM s) { delete (Cooldown *)scm_foreign_object_ref(s, 0); });
+
+static std::string cooldownKey(SCM key) {
+  if (SCM_IS_A_P(key, scm::foreign_type_convertible<ServerPlayer *>::type())) key = scm::to_scm(scm::from_scm<ServerPlayer *>(key)->getUUID());
+  if (SCM_IS_A_P(key, scm::foreign_type_convertible<mce::UUID>::type())) {
+    auto uuid = scm::from_scm<mce::UUID>(key);
+    return std::string("u").append((char const *)&uuid, sizeof(uuid));
+  }
+  return "s" + scm::from_scm<std::string>(key);
+}
+
+SCM_DEFINE_PUBLIC(c_make_cooldown, "make-cooldown", 1, 0, 0, (scm::val<uint64_t> duration), "Create cooldown set (duration in ticks)") {
+  return scm::to_scm(new Cooldown(duration));
+}
+
+SCM_DEFINE_PUBLIC(c_cooldown_check_set, "cooldown-check!", 2, 1, 0, (scm::val<Cooldown *> cd, SCM key, scm::val<uint64_t> duration),
+                  "Start cooldown for key unless it is already active, return #t if started") {
+  return scm::to_scm(cd->checkAndSet(cooldownKey(key), duration[cd->duration]));
+}
+
+SCM_DEFINE_PUBLIC(c_cooldown_set, "cooldown-set!", 2, 1, 0, (scm::val<Cooldown *> cd, SCM key, scm::val<uint64_t> duration),
+                  "(Re)start cooldown for key") {
+  cd->set(cooldownKey(key), duration[cd->duration]);
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_cooldown_active, "cooldown-active?", 2, 0, 0, (scm::val<Cooldown *> cd, SCM key), "Test if key is cooling down") {
+  return scm::to_scm(cd->remaining(cooldownKey(key)) > 0);
+}
+
+SCM_DEFINE_PUBLIC(c_cooldown_remaining, "cooldown-remaining", 2, 0, 0, (scm::val<Cooldown *> cd, SCM key), "Get remaining ticks of cooldown") {
+  return scm::to_scm(cd->remaining(cooldownKey(key)));
+}
+
+SCM_DEFINE_PUBLIC(c_cooldown_clear, "cooldown-clear!", 2, 0, 0, (scm::val<Cooldown *> cd, SCM key), "Cancel cooldown of key") {
+  cd->clear(cooldownKey(key));
+  return SCM_UNSPECIFIED;
+}
+
+PRELOAD_MODULE("minecraft cooldown") {
+#ifndef DIAG
+#include "main.x"
+#endif
+}
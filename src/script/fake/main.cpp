@@ -1,6 +1,13 @@
+// Deps: out/script_fake.so: out/script_base.so out/script_tick.so
+#include "../base/main.h"
+#include "../tick/main.h"
+
 #include <api.h>
 
 #include <StaticHook.h>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 
 struct ExplodePacket : Packet {
@@ -56,23 +63,200 @@ SCM_DEFINE_PUBLIC(fake_explode, "fake-explode", 3, 0, 0, (scm::val<float> size,
   return SCM_UNSPECIFIED;
 }
 
-int getParticleId(std::string const &name) {
+static const char *particleNames[] = { "none", "bubble", "crit", "smoke", "explode", "evaporation", "flame", "lava", "largesmoke", "redust",
+                                       "iconcrack", "snowballpoof", "largeexplode", "hugeexplosion", "mobflame", "heart", "terrain", "townaura",
+                                       "portal", "watersplash", "waterwake", "dripwater", "driplava", "fallingdust", "mobspell", "mobspellambient",
+                                       "mobspellinstantaneous", "ink", "slime", "rainsplash", "villagerangry", "villagerhappy", "enchantingtable",
+                                       "trackingemitter", "note", "witchspell", "carrotboost", "dragonbreath", "spit", "totem", "food", "conduit",
+                                       "bubblecolumnup", "bubblecolumndown", "forcefield", "risingreddust" };
+
+// Perfect hash over the interned symbols of the known particle names, built on the first tick since
+// ParticleTypeMap is only filled once the game has started (scripts load before that).
+// Symbols are compared by identity, so a lookup is one multiply, one shift and one compare.
+struct ParticleTable {
+  std::vector<std::pair<SCM, int>> slots;
+  uint64_t seed;
+  unsigned shift;
+
+  size_t index(SCM key) const { return ((uint64_t)SCM_UNPACK(key) * seed) >> shift; }
+
+  void build(std::vector<std::pair<SCM, int>> const &entries) {
+    uint64_t state = 0x9e3779b97f4a7c15;
+    for (unsigned bits = 6;; bits++) {
+      shift = 64 - bits;
+      for (int attempt = 0; attempt < 256; attempt++) {
+        state += 0x9e3779b97f4a7c15;
+        seed = (state ^ (state >> 31)) | 1;
+        slots.assign(1 << bits, { SCM_BOOL_F, -1 });
+        bool ok = true;
+        for (auto &entry : entries) {
+          auto &slot = slots[index(entry.first)];
+          if (scm_is_true(slot.first)) {
+            ok = false;
+            break;
+          }
+          slot = entry;
+        }
+        if (ok) return;
+      }
+    }
+  }
+
+  int lookup(SCM key) const {
+    auto &slot = slots[index(key)];
+    return scm_is_eq(slot.first, key) ? slot.second : -1;
+  }
+};
+
+static ParticleTable particleTable;
+
+static int lookupParticleTypeId(std::string const &name) {
   if (name == "forcefield") return 3;
   if (name == "risingreddust") return 11;
   return ParticleTypeMap::getParticleTypeId(name);
 }
 
-SCM_DEFINE_PUBLIC(fake_particle, "fake-particle", 3, 1, 0, (scm::val<std::string> name, scm::val<Vec3> pos, scm::val<int> did, scm::val<int> data),
+static void buildParticleTable() {
+  std::vector<std::pair<SCM, int>> entries;
+  for (auto name : particleNames) {
+    auto sym = scm_gc_protect_object(scm_from_utf8_symbol(name));
+    entries.emplace_back(sym, lookupParticleTypeId(name));
+  }
+  particleTable.build(entries);
+}
+
+// Names outside the table are resolved once; their symbols are kept alive so the keys stay unique
+static std::unordered_map<SCM, int> extraParticleIds;
+static constexpr size_t maxExtraParticleIds = 256;
+
+// Accepts an id, a symbol or a string; only names outside the table fall back to ParticleTypeMap
+static int particleIdFromScm(SCM name) {
+  if (scm_is_integer(name)) return scm::from_scm<int>(name);
+  SCM sym = scm_is_string(name) ? scm_string_to_symbol(name) : name;
+  if (particleTable.slots.empty()) return lookupParticleTypeId(scm::from_scm<std::string>(scm_symbol_to_string(sym))); // not cached yet
+  if (auto id = particleTable.lookup(sym); id >= 0) return id;
+  if (auto it = extraParticleIds.find(sym); it != extraParticleIds.end()) return it->second;
+  auto id = lookupParticleTypeId(scm::from_scm<std::string>(scm_symbol_to_string(sym)));
+  if (extraParticleIds.size() < maxExtraParticleIds) extraParticleIds.emplace(scm_gc_protect_object(sym), id);
+  return id;
+}
+
+SCM_DEFINE_PUBLIC(particle_id, "particle-id", 1, 0, 0, (SCM name), "Resolve particle name to id") { return scm::to_scm(particleIdFromScm(name)); }
+
+SCM_DEFINE_PUBLIC(particle_names, "particle-names", 0, 0, 0, (), "Get known particle names") {
+  SCM list = SCM_EOL;
+  for (auto it = std::rbegin(particleNames); it != std::rend(particleNames); it++) list = scm_cons(scm::to_scm(*it), list);
+  return list;
+}
+
+SCM_DEFINE_PUBLIC(fake_particle, "fake-particle", 3, 1, 0, (SCM name, scm::val<Vec3> pos, scm::val<int> did, scm::val<int> data),
                   "Create a fake particle") {
   auto &level = ServerCommand::mGame->getLevel();
   auto dim    = level.getDimension(DimensionId(did));
   if (!dim) return SCM_BOOL_F;
-  LevelEventPacket pkt{ LevelEvent(0x4000 + getParticleId(name)), pos.get(), data[0] };
+  LevelEventPacket pkt{ LevelEvent(0x4000 + particleIdFromScm(name)), pos.get(), data[0] };
   dim->sendPacketForPosition(BlockPos(pos), pkt, nullptr);
   return SCM_UNSPECIFIED;
 }
 
+struct QueuedParticle {
+  int dim, chunkX, chunkZ, id, data;
+  Vec3 pos;
+
+  bool operator<(QueuedParticle const &rhs) const { return std::tie(dim, chunkX, chunkZ) < std::tie(rhs.dim, rhs.chunkX, rhs.chunkZ); }
+};
+
+// Kept across ticks so the steady state does not allocate
+static std::vector<QueuedParticle> particleQueue;
+
+static void flushParticles() {
+  if (particleQueue.empty()) return;
+  std::sort(particleQueue.begin(), particleQueue.end());
+  auto &level    = ServerCommand::mGame->getLevel();
+  Dimension *dim = nullptr;
+  int did        = INT32_MIN;
+  for (auto const &particle : particleQueue) {
+    if (particle.dim != did) dim = level.getDimension(DimensionId(did = particle.dim));
+    if (!dim) continue;
+    LevelEventPacket pkt{ LevelEvent(0x4000 + particle.id), particle.pos, particle.data };
+    dim->sendPacketForPosition(BlockPos(particle.pos), pkt, nullptr);
+  }
+  particleQueue.clear();
+}
+
+SCM_DEFINE_PUBLIC(queue_particle, "queue-particle", 3, 1, 0, (SCM name, scm::val<Vec3> pos, scm::val<int> did, scm::val<int> data),
+                  "Queue a fake particle, sent at the end of the tick") {
+  Vec3 vec = pos;
+  BlockPos block(vec);
+  particleQueue.push_back({ did, block.x >> 4, block.z >> 4, particleIdFromScm(name), data[0], vec });
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(flush_particles, "flush-particles", 0, 0, 0, (), "Send queued fake particles now") {
+  flushParticles();
+  return SCM_UNSPECIFIED;
+}
+
+// A packet built once and re-sent with only its position patched. The position offset inside the
+// game's packet object is found by constructing it at a probe position and scanning for that value.
+struct PacketTemplate {
+  std::unique_ptr<Packet> packet;
+  size_t posOffset;
+
+  template <typename T, typename F> static PacketTemplate *make(F construct) {
+    static const Vec3 probe{ 1234.5f, -4321.25f, 2468.75f };
+    std::unique_ptr<Packet> packet{ construct(probe) };
+    for (size_t offset = sizeof(void *); offset + sizeof(Vec3) <= sizeof(T); offset += sizeof(float))
+      if (memcmp((char *)packet.get() + offset, &probe, sizeof(Vec3)) == 0) return new PacketTemplate{ std::move(packet), offset };
+    packet.reset(); // scm_misc_error does not unwind C++ frames
+    scm_misc_error("packet-template", "Cannot locate position field", SCM_EOL);
+    return nullptr;
+  }
+
+  void setPos(Vec3 const &pos) { memcpy((char *)packet.get() + posOffset, &pos, sizeof(Vec3)); }
+};
+
+namespace scm {
+template <> struct convertible<PacketTemplate *> : foreign_object_is_convertible<PacketTemplate *> {};
+} // namespace scm
+
+MAKE_FOREIGN_TYPE(PacketTemplate *, "packet-template", [](SCM s) { delete (PacketTemplate *)scm_foreign_object_ref(s, 0); });
+
+SCM_DEFINE_PUBLIC(explode_template, "make-explode-template", 1, 0, 0, (scm::val<float> size), "Prebuild fake explode packet") {
+  float radius = size;
+  return scm::to_scm(PacketTemplate::make<ExplodePacket>([=](Vec3 const &pos) { return new ExplodePacket(pos, radius, {}); }));
+}
+
+SCM_DEFINE_PUBLIC(particle_template, "make-particle-template", 1, 1, 0, (SCM name, scm::val<int> data), "Prebuild fake particle packet") {
+  auto type = LevelEvent(0x4000 + particleIdFromScm(name));
+  int flag  = data[0];
+  return scm::to_scm(PacketTemplate::make<LevelEventPacket>([=](Vec3 const &pos) { return new LevelEventPacket(type, pos, flag); }));
+}
+
+SCM_DEFINE_PUBLIC(send_template, "send-packet-template", 3, 0, 0, (scm::val<PacketTemplate *> tpl, scm::val<Vec3> pos, scm::val<int> did),
+                  "Send prebuilt packet at position") {
+  auto dim = ServerCommand::mGame->getLevel().getDimension(DimensionId(did));
+  if (!dim) return SCM_BOOL_F;
+  Vec3 vec = pos;
+  tpl->setPos(vec);
+  dim->sendPacketForPosition(BlockPos(vec), *tpl->packet, nullptr);
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(send_template_players, "send-packet-template/players", 3, 0, 0,
+                  (scm::val<PacketTemplate *> tpl, scm::val<Vec3> pos, scm::slist<ServerPlayer *> players), "Send prebuilt packet to players") {
+  auto packet = tpl.get();
+  packet->setPos(pos);
+  for (auto player : players) player->sendNetworkPacket(*packet->packet);
+  return SCM_UNSPECIFIED;
+}
+
 PRELOAD_MODULE("minecraft fake") {
+  onPostTick([] {
+    if (particleTable.slots.empty()) buildParticleTable();
+    flushParticles();
+  });
+
 #ifndef DIAG
 #include "main.x"
 #endif
@@ -0,0 +1,262 @@
+// Deps: out/script_journal.so: out/script_base.so out/script_tick.so out/script_world.so out/script_policy.so
+#include "../base/main.h"
+#include "../policy/main.h"
+#include "../tick/main.h"
+#include "../world/main.h"
+
+#include <api.h>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+struct BlockTypeRegistry {
+  static BlockLegacy *lookupByName(std::string const &);
+};
+
+struct JournalRecord {
+  uint64_t tick;
+  uint64_t most, least; // player uuid
+  int32_t dim, x, y, z;
+  uint32_t before, after; // palette ids
+};
+
+static_assert(sizeof(JournalRecord) == 48);
+
+struct JournalHeader {
+  char magic[8];
+  uint64_t count;
+  char padding[48];
+};
+
+static_assert(sizeof(JournalHeader) == 64);
+
+static constexpr char journalMagic[8] = { 'M', 'J', 'O', 'U', 'R', 'N', 'L', '1' };
+
+// Append-only block change log. Records live in a memory-mapped file so appending is a store into
+// the mapping; blocks are written as ids of a palette kept in a side file. Records of one chunk are
+// chained newest to oldest through previous, which is sized along with the mapping, so appending
+// to a known chunk allocates nothing and area/time queries stop at the first record out of the window.
+struct Journal {
+  static constexpr uint32_t none = UINT32_MAX;
+  static constexpr size_t minCapacity = 1 << 16;
+
+  int fd = -1;
+  JournalHeader *header = nullptr;
+  size_t capacity = 0; // records
+  uint64_t tickBase;
+  std::ofstream paletteFile;
+  std::vector<Block *> palette;
+  std::unordered_map<Block *, uint32_t> paletteIds;
+  std::unordered_map<uint64_t, uint32_t> chunks; // newest record of each chunk
+  std::vector<uint32_t> previous;                // older record of the same chunk
+  std::vector<uint32_t> scratch;
+
+  static uint64_t chunkKey(int dim, int cx, int cz) {
+    return ((uint64_t)(uint8_t)dim << 56) | ((uint64_t)((uint32_t)cx & 0xFFFFFFF) << 28) | ((uint32_t)cz & 0xFFFFFFF);
+  }
+  static int chunkX(uint64_t key) { return (int32_t)((uint32_t)(key >> 28) << 4) >> 4; }
+  static int chunkZ(uint64_t key) { return (int32_t)((uint32_t)key << 4) >> 4; }
+
+  void link(uint32_t index, uint64_t key) {
+    auto [it, inserted] = chunks.try_emplace(key, index);
+    previous[index]     = inserted ? none : it->second;
+    it->second          = index;
+  }
+
+  static size_t mappedSize(size_t capacity) { return sizeof(JournalHeader) + capacity * sizeof(JournalRecord); }
+
+  JournalRecord *records() const { return (JournalRecord *)(header + 1); }
+
+  ~Journal() {
+    if (header) munmap(header, mappedSize(capacity));
+    if (fd != -1) close(fd);
+  }
+
+  bool open(std::string const &path) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) return false;
+    auto size = lseek(fd, 0, SEEK_END);
+    capacity  = size < (off_t)sizeof(JournalHeader) ? 0 : (size - sizeof(JournalHeader)) / sizeof(JournalRecord);
+    if (capacity < minCapacity) {
+      // New or truncated files start at the default size, grow() could never double a capacity of 0
+      capacity = minCapacity;
+      if (ftruncate(fd, mappedSize(capacity))) return false;
+    }
+    auto mapped = mmap(nullptr, mappedSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) return false;
+    header = (JournalHeader *)mapped;
+    if (size < (off_t)sizeof(JournalHeader)) memcpy(header->magic, journalMagic, sizeof journalMagic);
+    if (memcmp(header->magic, journalMagic, sizeof journalMagic) || header->count > capacity) return false;
+
+    std::ifstream input(path + ".palette");
+    std::string name;
+    int data;
+    while (input >> name >> data) {
+      Block *block = nullptr;
+      if (auto legacy = BlockTypeRegistry::lookupByName(name)) block = legacy->getBlockStateFromLegacyData(data);
+      if (block) paletteIds.emplace(block, palette.size());
+      palette.push_back(block);
+    }
+    paletteFile.open(path + ".palette", std::ios::app);
+
+    auto all = records();
+    previous.resize(capacity);
+    chunks.reserve(1024);
+    for (uint32_t i = 0; i < header->count; i++) link(i, chunkKey(all[i].dim, all[i].x >> 4, all[i].z >> 4));
+    // Ticks restart with the server, keep journal time monotonic across restarts
+    tickBase = (header->count ? all[header->count - 1].tick + 1 : 0) - getCurrentTick();
+    return true;
+  }
+
+  uint64_t now() const { return tickBase + getCurrentTick(); }
+
+  uint32_t blockId(Block *block) {
+    auto [it, inserted] = paletteIds.try_emplace(block, palette.size());
+    if (inserted) {
+      palette.push_back(block);
+      // Handed to the kernel before any record using the id is stored, so both survive a crash together
+      paletteFile << block->getLegacyBlock()->getFullName() << ' ' << (int)blockData(block) << '\n';
+      paletteFile.flush();
+    }
+    return it->second;
+  }
+
+  static uint8_t blockData(Block *block) {
+    auto legacy = block->getLegacyBlock();
+    for (int data = 0; data < 16; data++)
+      if (legacy->getBlockStateFromLegacyData(data) == block) return data;
+    return 0;
+  }
+
+  bool grow() {
+    auto next   = capacity * 2;
+    if (ftruncate(fd, mappedSize(next))) return false;
+    auto mapped = mremap(header, mappedSize(capacity), mappedSize(next), MREMAP_MAYMOVE);
+    if (mapped == MAP_FAILED) return false;
+    header   = (JournalHeader *)mapped;
+    capacity = next;
+    previous.resize(capacity);
+    return true;
+  }
+
+  void append(ServerPlayer *player, BlockPos const &pos, Block *before, Block *after) {
+    if (header->count == capacity && !grow()) return;
+    auto from = blockId(before), to = blockId(after);
+    if (!paletteFile) return; // a record must never refer to a palette line that did not reach the file
+    auto &uuid   = player->getUUID();
+    auto index   = header->count;
+    records()[index] = { now(), uuid.most, uuid.least, player->getDimensionId(), pos.x, pos.y, pos.z, from, to };
+    header->count = index + 1;
+    link(index, chunkKey(player->getDimensionId(), pos.x >> 4, pos.z >> 4));
+  }
+
+  // Visits records inside the cuboid since the given journal tick, chunk by chunk, oldest first within a chunk.
+  // Areas spanning more chunks than have records walk the recorded chunks instead.
+  template <typename F> void query(int dim, BlockPos const &a, BlockPos const &b, uint64_t since, F f) {
+    int x0 = std::min(a.x, b.x), x1 = std::max(a.x, b.x), y0 = std::min(a.y, b.y), y1 = std::max(a.y, b.y), z0 = std::min(a.z, b.z),
+        z1 = std::max(a.z, b.z);
+    auto all   = records();
+    auto visit = [&](uint32_t newest) {
+      scratch.clear();
+      for (auto i = newest; i != none && all[i].tick >= since; i = previous[i]) scratch.push_back(i);
+      for (auto i = scratch.rbegin(); i != scratch.rend(); ++i) {
+        auto &record = all[*i];
+        if (record.dim == dim && record.x >= x0 && record.x <= x1 && record.y >= y0 && record.y <= y1 && record.z >= z0 && record.z <= z1)
+          f(record);
+      }
+    };
+    if (double((x1 >> 4) - (x0 >> 4) + 1) * double((z1 >> 4) - (z0 >> 4) + 1) > chunks.size()) {
+      for (auto &[key, newest] : chunks) {
+        int cx = chunkX(key), cz = chunkZ(key);
+        if (key >> 56 == (uint8_t)dim && cx >= x0 >> 4 && cx <= x1 >> 4 && cz >= z0 >> 4 && cz <= z1 >> 4) visit(newest);
+      }
+      return;
+    }
+    for (int cx = x0 >> 4; cx <= x1 >> 4; cx++)
+      for (int cz = z0 >> 4; cz <= z1 >> 4; cz++)
+        if (auto it = chunks.find(chunkKey(dim, cx, cz)); it != chunks.end()) visit(it->second);
+  }
+};
+
+static std::unique_ptr<Journal> journal;
+
+SCM_DEFINE_PUBLIC(journal_open, "journal-open", 1, 0, 0, (scm::val<std::string> path), "Start recording player block changes into file") {
+  auto next = std::make_unique<Journal>();
+  if (!next->open(path)) return SCM_BOOL_F;
+  journal = std::move(next);
+  return SCM_BOOL_T;
+}
+
+SCM_DEFINE_PUBLIC(journal_close, "journal-close", 0, 0, 0, (), "Stop recording block changes") {
+  journal.reset();
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(journal_count, "journal-count", 0, 0, 0, (), "Get number of recorded block changes") {
+  if (!journal) return SCM_BOOL_F;
+  return scm::to_scm(journal->header->count);
+}
+
+static Block *paletteBlock(uint32_t id) { return id < journal->palette.size() ? journal->palette[id] : nullptr; }
+
+static SCM blockOrFalse(Block *block) { return block ? scm::to_scm(block) : SCM_BOOL_F; }
+
+static bool matchPlayer(JournalRecord const &record, SCM uuid) {
+  if (SCM_UNBNDP(uuid) || scm_is_false(uuid)) return true;
+  auto target = scm::from_scm<mce::UUID>(uuid);
+  return record.most == target.most && record.least == target.least;
+}
+
+SCM_DEFINE_PUBLIC(journal_query, "journal-query", 4, 1, 0,
+                  (scm::val<int> did, scm::val<BlockPos> min, scm::val<BlockPos> max, scm::val<uint64_t> ticks, SCM uuid),
+                  "List changes in cuboid during the last ticks as (tick uuid pos before after)") {
+  if (!journal) return SCM_BOOL_F;
+  auto now   = journal->now();
+  auto since = now > ticks ? now - ticks : 0;
+  SCM list   = SCM_EOL;
+  journal->query(did, min, max, since, [&](JournalRecord const &record) {
+    if (!matchPlayer(record, uuid)) return;
+    mce::UUID player;
+    player.most  = record.most;
+    player.least = record.least;
+    list = scm_cons(scm::list(record.tick, player, BlockPos{ record.x, record.y, record.z }, blockOrFalse(paletteBlock(record.before)),
+                              blockOrFalse(paletteBlock(record.after))),
+                    list);
+  });
+  return scm_reverse(list);
+}
+
+SCM_DEFINE_PUBLIC(journal_rollback, "journal-rollback", 4, 2, 0,
+                  (scm::val<int> did, scm::val<BlockPos> min, scm::val<BlockPos> max, scm::val<uint64_t> ticks, SCM uuid, SCM callback),
+                  "Restore blocks in cuboid changed during the last ticks (optionally only by one player)") {
+  if (!journal) return SCM_BOOL_F;
+  auto now   = journal->now();
+  auto since = now > ticks ? now - ticks : 0;
+  // The oldest matching record of each position holds the block to restore
+  std::unordered_map<uint64_t, BlockWrite> oldest;
+  journal->query(did, min, max, since, [&](JournalRecord const &record) {
+    if (!matchPlayer(record, uuid)) return;
+    auto block = paletteBlock(record.before);
+    if (!block) return;
+    auto key = ((uint64_t)(record.x & 0x3FFFFFF) << 38) | ((uint64_t)(record.z & 0x3FFFFFF) << 12) | (record.y & 0xFFF); // exact within world bounds
+    oldest.try_emplace(key, BlockWrite{ record.x, record.y, record.z, block });
+  });
+  std::vector<BlockWrite> writes;
+  writes.reserve(oldest.size());
+  for (auto &[key, write] : oldest) writes.push_back(write);
+  return scm::to_scm(queueBlockWrites(did, std::move(writes), SCM_UNBNDP(callback) ? SCM_BOOL_F : callback));
+}
+
+PRELOAD_MODULE("minecraft journal") {
+#ifndef DIAG
+#include "main.x"
+#endif
+  onPlayerBlockChange([](ServerPlayer *player, BlockPos const &pos, Block *before, Block *after) {
+    if (journal) journal->append(player, pos, before, after);
+  });
+}
@@ -0,0 +1,598 @@
+#include <api.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Same representation as guile-json: objects parse into hash tables (alists and hash tables are
+// accepted when building), arrays are lists, null is #nil.
+
+SCM_SYMBOL(json_invalid, "json-invalid");
+SCM_SYMBOL(object_sym, "object");
+SCM_SYMBOL(array_sym, "array");
+
+// Word at a time scanning, eight bytes per step until something interesting shows up
+static constexpr uint64_t ones  = 0x0101010101010101ull;
+static constexpr uint64_t highs = 0x8080808080808080ull;
+
+static inline uint64_t loadWord(char const *ptr) {
+  uint64_t word;
+  memcpy(&word, ptr, sizeof word);
+  return word;
+}
+static inline bool hasByte(uint64_t word, uint8_t byte) {
+  auto masked = word ^ (ones * byte);
+  return (masked - ones) & ~masked & highs;
+}
+static inline bool hasLess(uint64_t word, uint8_t bound) { return (word - ones * bound) & ~word & highs; }
+
+struct JsonParser {
+  char const *begin, *ptr, *end;
+  char const *error = nullptr;
+  int depth         = 0;
+  std::string buffer;
+
+  static constexpr int maxDepth = 512;
+
+  SCM fail(char const *reason) {
+    if (!error) error = reason;
+    return SCM_BOOL_F;
+  }
+
+  void skipSpace() {
+    while (ptr < end && (*ptr == ' ' || *ptr == '\n' || *ptr == '\r' || *ptr == '\t' || *ptr == '\v')) ptr++;
+  }
+
+  bool literal(char const *text, size_t length) {
+    if ((size_t)(end - ptr) < length || memcmp(ptr, text, length)) return false;
+    ptr += length;
+    return true;
+  }
+
+  static int hex(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+  }
+
+  bool unit(uint32_t &value) {
+    if (end - ptr < 4) return false;
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+      auto digit = hex(ptr[i]);
+      if (digit < 0) return false;
+      value = value << 4 | digit;
+    }
+    ptr += 4;
+    return true;
+  }
+
+  void utf8(uint32_t cp) {
+    if (cp < 0x80) {
+      buffer += (char)cp;
+    } else if (cp < 0x800) {
+      buffer += (char)(0xC0 | cp >> 6);
+      buffer += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      buffer += (char)(0xE0 | cp >> 12);
+      buffer += (char)(0x80 | (cp >> 6 & 0x3F));
+      buffer += (char)(0x80 | (cp & 0x3F));
+    } else {
+      buffer += (char)(0xF0 | cp >> 18);
+      buffer += (char)(0x80 | (cp >> 12 & 0x3F));
+      buffer += (char)(0x80 | (cp >> 6 & 0x3F));
+      buffer += (char)(0x80 | (cp & 0x3F));
+    }
+  }
+
+  // Expects ptr past the opening quote, leaves the decoded text in buffer
+  bool string() {
+    buffer.clear();
+    for (;;) {
+      auto run = ptr;
+      while (end - ptr >= 8) {
+        auto word = loadWord(ptr);
+        if (hasByte(word, '"') || hasByte(word, '\\')) break;
+        ptr += 8;
+      }
+      while (ptr < end && *ptr != '"' && *ptr != '\\') ptr++;
+      buffer.append(run, ptr);
+      if (ptr == end) return false;
+      if (*ptr++ == '"') return true;
+      if (ptr == end) return false;
+      switch (*ptr++) {
+      case '"': buffer += '"'; break;
+      case '\\': buffer += '\\'; break;
+      case '/': buffer += '/'; break;
+      case 'b': buffer += '\b'; break;
+      case 'f': buffer += '\f'; break;
+      case 'n': buffer += '\n'; break;
+      case 'r': buffer += '\r'; break;
+      case 't': buffer += '\t'; break;
+      case 'u': {
+        uint32_t cp;
+        if (!unit(cp)) return false;
+        if (cp >= 0xD800 && cp < 0xDC00 && end - ptr >= 6 && ptr[0] == '\\' && ptr[1] == 'u') {
+          ptr += 2;
+          uint32_t low;
+          if (!unit(low)) return false;
+          if (low >= 0xDC00 && low < 0xE000)
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          else
+            utf8(cp), cp = low;
+        }
+        utf8(cp);
+        break;
+      }
+      default: return false;
+      }
+    }
+  }
+
+  SCM number() {
+    auto start = ptr;
+    if (ptr < end && *ptr == '-') ptr++;
+    if (ptr == end || *ptr < '0' || *ptr > '9') return fail("invalid number");
+    if (*ptr == '0')
+      ptr++;
+    else
+      while (ptr < end && *ptr >= '0' && *ptr <= '9') ptr++;
+    bool real = false;
+    if (ptr < end && *ptr == '.') {
+      real = true;
+      if (++ptr == end || *ptr < '0' || *ptr > '9') return fail("invalid number");
+      while (ptr < end && *ptr >= '0' && *ptr <= '9') ptr++;
+    }
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+      real = true;
+      if (++ptr < end && (*ptr == '+' || *ptr == '-')) ptr++;
+      if (ptr == end || *ptr < '0' || *ptr > '9') return fail("invalid number");
+      while (ptr < end && *ptr >= '0' && *ptr <= '9') ptr++;
+    }
+    if (real) return scm_from_double(strtod(std::string(start, ptr).c_str(), nullptr));
+    auto digits = start + (*start == '-');
+    if (ptr - digits > 18) return scm_c_locale_stringn_to_number(start, ptr - start, 10);
+    int64_t value = 0;
+    for (auto it = digits; it != ptr; ++it) value = value * 10 + (*it - '0');
+    return scm_from_int64(*start == '-' ? -value : value);
+  }
+
+  SCM object() {
+    SCM table = scm_c_make_hash_table(8);
+    skipSpace();
+    if (ptr < end && *ptr == '}') return ptr++, table;
+    for (;;) {
+      skipSpace();
+      if (ptr == end || *ptr++ != '"' || !string()) return fail("invalid object key");
+      SCM key = scm_from_utf8_stringn(buffer.data(), buffer.size());
+      skipSpace();
+      if (ptr == end || *ptr++ != ':') return fail("expected ':'");
+      SCM item = value();
+      if (error) return SCM_BOOL_F;
+      scm_hash_set_x(table, key, item);
+      skipSpace();
+      if (ptr == end) return fail("unterminated object");
+      if (*ptr == ',') {
+        ptr++;
+        continue;
+      }
+      if (*ptr++ == '}') return table;
+      return fail("expected ',' or '}'");
+    }
+  }
+
+  SCM array() {
+    SCM list = SCM_EOL;
+    skipSpace();
+    if (ptr < end && *ptr == ']') return ptr++, list;
+    for (;;) {
+      SCM item = value();
+      if (error) return SCM_BOOL_F;
+      list = scm_cons(item, list);
+      skipSpace();
+      if (ptr == end) return fail("unterminated array");
+      if (*ptr == ',') {
+        ptr++;
+        continue;
+      }
+      if (*ptr++ == ']') return scm_reverse_x(list, SCM_EOL);
+      return fail("expected ',' or ']'");
+    }
+  }
+
+  SCM value() {
+    skipSpace();
+    if (ptr == end) return fail("unexpected end of input");
+    switch (*ptr) {
+    case '{':
+    case '[': {
+      if (++depth > maxDepth) return fail("nested too deeply");
+      SCM ret = *ptr++ == '{' ? object() : array();
+      depth--;
+      return ret;
+    }
+    case '"':
+      ptr++;
+      if (!string()) return fail("invalid string");
+      return scm_from_utf8_stringn(buffer.data(), buffer.size());
+    case 't': return literal("true", 4) ? SCM_BOOL_T : fail("invalid literal");
+    case 'f': return literal("false", 5) ? SCM_BOOL_F : fail("invalid literal");
+    case 'n': return literal("null", 4) ? SCM_ELISP_NIL : fail("invalid literal");
+    default: return number();
+    }
+  }
+
+  SCM document() {
+    SCM ret = value();
+    skipSpace();
+    if (!error && ptr != end) fail("trailing characters");
+    return ret;
+  }
+};
+
+// Appends straight into one buffer. With a port attached the buffer is handed over in large chunks,
+// so big documents never exist as a whole in memory.
+struct JsonOutput {
+  std::string buffer;
+  SCM port   = SCM_BOOL_F;
+  SCM error  = SCM_BOOL_F;
+  bool escape = false, pretty = false;
+
+  static constexpr size_t chunk = 64 * 1024;
+
+  void flush() {
+    if (scm_is_false(port) || buffer.empty()) return;
+    scm_lfwrite(buffer.data(), buffer.size(), port);
+    buffer.clear();
+  }
+
+  void checkpoint() {
+    if (buffer.size() >= chunk) flush();
+  }
+
+  void unicode(uint32_t unit) {
+    char text[8];
+    snprintf(text, sizeof text, "\\u%04x", unit);
+    buffer.append(text, 6);
+  }
+
+  // Non-ASCII is written as \u escapes like guile-json does, so output is always plain ASCII
+  void string(char const *text, size_t length) {
+    buffer += '"';
+    auto ptr = text, end = text + length;
+    while (ptr < end) {
+      auto run = ptr;
+      while (end - ptr >= 8) {
+        auto word = loadWord(ptr);
+        if ((word & highs) || hasLess(word, 0x20) || hasByte(word, '"') || hasByte(word, '\\') || (escape && hasByte(word, '/'))) break;
+        ptr += 8;
+      }
+      while (ptr < end) {
+        auto ch = (uint8_t)*ptr;
+        if (ch >= 0x80 || ch < 0x20 || ch == '"' || ch == '\\' || (escape && ch == '/')) break;
+        ptr++;
+      }
+      buffer.append(run, ptr);
+      if (ptr == end) break;
+      auto ch = (uint8_t)*ptr++;
+      switch (ch) {
+      case '"': buffer += "\\\""; continue;
+      case '\\': buffer += "\\\\"; continue;
+      case '/': buffer += "\\/"; continue;
+      case '\b': buffer += "\\b"; continue;
+      case '\f': buffer += "\\f"; continue;
+      case '\n': buffer += "\\n"; continue;
+      case '\r': buffer += "\\r"; continue;
+      case '\t': buffer += "\\t"; continue;
+      }
+      if (ch < 0x80) {
+        unicode(ch);
+        continue;
+      }
+      uint32_t cp;
+      int extra;
+      if (ch >= 0xF0)
+        cp = ch & 0x07, extra = 3;
+      else if (ch >= 0xE0)
+        cp = ch & 0x0F, extra = 2;
+      else
+        cp = ch & 0x1F, extra = 1;
+      for (; extra && ptr < end; extra--) cp = cp << 6 | (*ptr++ & 0x3F);
+      if (cp >= 0x10000) {
+        cp -= 0x10000;
+        unicode(0xD800 + (cp >> 10));
+        unicode(0xDC00 + (cp & 0x3FF));
+      } else {
+        unicode(cp);
+      }
+    }
+    buffer += '"';
+  }
+
+  void string(SCM str) {
+    size_t length;
+    auto text = scm_to_utf8_stringn(str, &length);
+    string(text, length);
+    free(text);
+  }
+
+  void key(SCM key) {
+    if (scm_is_string(key))
+      string(key);
+    else if (scm_is_symbol(key))
+      string(scm_symbol_to_string(key));
+    else if (SCM_CHARP(key))
+      string(scm_c_make_string(1, key));
+    else
+      string(scm_number_to_string(key, SCM_UNDEFINED));
+  }
+
+  void number(SCM num) {
+    if (scm_is_signed_integer(num, INT64_MIN, INT64_MAX)) {
+      char text[24];
+      buffer.append(text, snprintf(text, sizeof text, "%lld", (long long)scm_to_int64(num)));
+      return;
+    }
+    if (scm_is_rational(num) && !scm_is_integer(num)) num = scm_exact_to_inexact(num);
+    size_t length;
+    auto text = scm_to_utf8_stringn(scm_number_to_string(num, SCM_UNDEFINED), &length);
+    buffer.append(text, length);
+    free(text);
+  }
+
+  void indent(int level) {
+    if (pretty) buffer.append(2 * level, ' ');
+  }
+
+  void newline() {
+    if (pretty) buffer += '\n';
+  }
+
+  static bool atom(SCM value) { return scm_is_string(value) || scm_is_symbol(value) || scm_is_number(value) || SCM_CHARP(value); }
+
+  static bool alist(SCM value) {
+    if (!scm_is_pair(value) || scm_ilength(value) < 0) return false;
+    for (; !scm_is_null(value); value = SCM_CDR(value))
+      if (!scm_is_pair(value) || !scm_is_pair(SCM_CAR(value)) || !atom(SCM_CAR(SCM_CAR(value)))) return false;
+    return true;
+  }
+
+  void object(SCM pairs, int level) {
+    if (level > 0) newline();
+    indent(level);
+    buffer += '{';
+    newline();
+    for (bool first = true; scm_is_pair(pairs); pairs = SCM_CDR(pairs), first = false) {
+      if (!first) {
+        buffer += ',';
+        newline();
+      }
+      indent(level + 1);
+      key(SCM_CAR(SCM_CAR(pairs)));
+      if (pretty) buffer += ' ';
+      buffer += ':';
+      if (pretty) buffer += ' ';
+      value(SCM_CDR(SCM_CAR(pairs)), level + 1);
+    }
+    newline();
+    indent(level);
+    buffer += '}';
+  }
+
+  void array(SCM items, int level) {
+    buffer += '[';
+    for (bool first = true; scm_is_pair(items); items = SCM_CDR(items), first = false) {
+      if (!first) {
+        buffer += ',';
+        if (pretty) buffer += ' ';
+      }
+      value(SCM_CAR(items), level + 1);
+    }
+    buffer += ']';
+  }
+
+  static SCM consPair(void *, SCM key, SCM value, SCM result) { return scm_cons(scm_cons(key, value), result); }
+
+  static constexpr int maxDepth = 512;
+
+  void value(SCM value, int level = 0) {
+    if (scm_is_true(error)) return;
+    if (level > maxDepth) {
+      error = value;
+      return;
+    }
+    if (scm_is_eq(value, SCM_ELISP_NIL))
+      buffer += "null";
+    else if (scm_is_bool(value))
+      buffer += scm_is_true(value) ? "true" : "false";
+    else if (scm_is_number(value))
+      number(value);
+    else if (scm_is_symbol(value))
+      string(scm_symbol_to_string(value));
+    else if (scm_is_string(value))
+      string(value);
+    else if (alist(value))
+      object(value, level);
+    else if (scm_ilength(value) >= 0)
+      array(value, level);
+    else if (scm_is_true(scm_hash_table_p(value)))
+      object(scm_internal_hash_fold(consPair, nullptr, SCM_EOL, value), level);
+    else
+      error = value;
+    checkpoint();
+  }
+};
+
+static SCM parseJson(std::string const &text) {
+  char const *error;
+  size_t offset;
+  SCM ret;
+  {
+    JsonParser parser{ text.data(), text.data(), text.data() + text.size() };
+    ret    = parser.document();
+    error  = parser.error;
+    offset = parser.ptr - parser.begin;
+  }
+  if (error) scm_throw(json_invalid, scm::list(scm::to_scm(error), scm::to_scm(offset)));
+  return ret;
+}
+
+// Consumes exactly one value from port: containers and strings up to their closing character,
+// numbers and literals up to the next delimiter, which stays unread along with everything after it
+static std::string readJsonValue(SCM port) {
+  std::string text;
+  int ch;
+  while ((ch = scm_peek_byte_or_eof(port)) == ' ' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\v') scm_get_byte_or_eof(port);
+  if (ch == EOF) return text;
+  if (ch != '{' && ch != '[' && ch != '"') {
+    while ((ch = scm_peek_byte_or_eof(port)) != EOF && !strchr(" \n\r\t\v,:]}", ch)) text += (char)scm_get_byte_or_eof(port);
+    return text;
+  }
+  int depth   = 0;
+  bool quoted = false, escaped = false;
+  while ((ch = scm_get_byte_or_eof(port)) != EOF) {
+    text += (char)ch;
+    if (quoted) {
+      if (escaped)
+        escaped = false;
+      else if (ch == '\\')
+        escaped = true;
+      else if (ch == '"' && (quoted = false, depth == 0))
+        break;
+    } else if (ch == '"') {
+      quoted = true;
+    } else if (ch == '{' || ch == '[') {
+      depth++;
+    } else if ((ch == '}' || ch == ']') && --depth == 0) {
+      break;
+    }
+  }
+  return text;
+}
+
+static void buildJson(JsonOutput &output, SCM value) {
+  output.value(value);
+  SCM error    = output.error;
+  output.error = SCM_BOOL_F;
+  if (scm_is_true(error)) scm_throw(json_invalid, scm::list(error));
+}
+
+SCM_DEFINE_PUBLIC(json_string_to_scm, "json-string->scm", 1, 0, 0, (scm::val<std::string> str), "Parse JSON document from string") {
+  return parseJson(str);
+}
+
+SCM_DEFINE_PUBLIC(json_read, "json-read", 0, 1, 0, (SCM port), "Parse one JSON value from port, leaving the rest unread") {
+  return parseJson(readJsonValue(SCM_UNBNDP(port) ? scm_current_input_port() : port));
+}
+
+SCM_DEFINE_PUBLIC(scm_to_json_string, "scm->json-string", 1, 2, 0, (SCM value, SCM escape, SCM pretty), "Build JSON document into a string") {
+  JsonOutput output;
+  output.escape = !SCM_UNBNDP(escape) && scm_is_true(escape);
+  output.pretty = !SCM_UNBNDP(pretty) && scm_is_true(pretty);
+  buildJson(output, value);
+  return scm_from_latin1_stringn(output.buffer.data(), output.buffer.size());
+}
+
+SCM_DEFINE_PUBLIC(scm_to_json_port, "scm->json", 2, 2, 0, (SCM value, SCM port, SCM escape, SCM pretty), "Write JSON document to port") {
+  JsonOutput output;
+  output.port   = port;
+  output.escape = !SCM_UNBNDP(escape) && scm_is_true(escape);
+  output.pretty = !SCM_UNBNDP(pretty) && scm_is_true(pretty);
+  buildJson(output, value);
+  output.flush();
+  return SCM_UNSPECIFIED;
+}
+
+// Incremental writer for documents too large to assemble as one Scheme value first
+struct JsonWriter {
+  JsonOutput output;
+  struct Frame {
+    bool object, first;
+  };
+  std::vector<Frame> frames;
+  bool keyed = false;
+
+  JsonWriter(SCM port) {
+    output.port = scm_gc_protect_object(port);
+  }
+  ~JsonWriter() { scm_gc_unprotect_object(output.port); }
+
+  // Separator before the next element, nullptr if one is not allowed here
+  char const *element() {
+    if (frames.empty()) return "";
+    auto &frame = frames.back();
+    if (frame.object && !keyed) return nullptr;
+    if (frame.object) {
+      keyed = false;
+      return "";
+    }
+    if (frame.first) return frame.first = false, "";
+    return ",";
+  }
+};
+
+namespace scm {
+template <> struct convertible<JsonWriter *> : foreign_object_is_convertible<JsonWriter *> {};
+} // namespace scm
+
+MAKE_FOREIGN_TYPE(JsonWriter *, "json-writer", [](SCM s) { delete (JsonWriter *)scm_foreign_object_ref(s, 0); });
+
+SCM_DEFINE_PUBLIC(c_make_json_writer, "make-json-writer", 1, 0, 0, (SCM port), "Create incremental JSON writer on port") {
+  return scm::to_scm(new JsonWriter(port));
+}
+
+static char const *writerElement(JsonWriter *writer, char const *who) {
+  auto separator = writer->element();
+  if (!separator) scm_misc_error(who, "Object member written without a key", SCM_EOL);
+  return separator;
+}
+
+SCM_DEFINE_PUBLIC(c_json_writer_begin, "json-writer-begin!", 2, 0, 0, (scm::val<JsonWriter *> writer, SCM kind),
+                  "Open nested 'object or 'array") {
+  bool object = scm_is_eq(kind, object_sym);
+  if (!object && !scm_is_eq(kind, array_sym)) scm_wrong_type_arg("json-writer-begin!", 2, kind);
+  writer->output.buffer += writerElement(writer, "json-writer-begin!");
+  writer->output.buffer += object ? '{' : '[';
+  writer->frames.push_back({ object, true });
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_json_writer_key, "json-writer-key!", 2, 0, 0, (scm::val<JsonWriter *> writer, SCM key), "Write key of next object member") {
+  if (writer->frames.empty() || !writer->frames.back().object || writer->keyed)
+    scm_misc_error("json-writer-key!", "Key written outside of object", SCM_EOL);
+  auto &frame = writer->frames.back();
+  if (!frame.first) writer->output.buffer += ',';
+  frame.first = false;
+  writer->output.key(key);
+  writer->output.buffer += ':';
+  writer->keyed = true;
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_json_writer_value, "json-writer-value!", 2, 0, 0, (scm::val<JsonWriter *> writer, SCM value), "Write complete value") {
+  writer->output.buffer += writerElement(writer, "json-writer-value!");
+  buildJson(writer->output, value);
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_json_writer_end, "json-writer-end!", 1, 0, 0, (scm::val<JsonWriter *> writer), "Close innermost object or array") {
+  if (writer->frames.empty() || writer->keyed) scm_misc_error("json-writer-end!", "Nothing to close", SCM_EOL);
+  writer->output.buffer += writer->frames.back().object ? '}' : ']';
+  writer->frames.pop_back();
+  writer->output.checkpoint();
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_json_writer_flush, "json-writer-flush!", 1, 0, 0, (scm::val<JsonWriter *> writer), "Write buffered output to port") {
+  writer->output.flush();
+  return SCM_UNSPECIFIED;
+}
+
+PRELOAD_MODULE("minecraft json") {
+#ifndef DIAG
+#include "main.x"
+#endif
+}
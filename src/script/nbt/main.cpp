@@ -5,114 +5,272 @@
 #include <api.h>
 #include <tags.h>
 
-
 #include "main.h"
 
-TInstanceHook(std::string, _ZNK11CompoundTag8toStringB5cxx11Ev, CompoundTag) {
-  std::stringstream ss;
-  ss << "(Compound";
-  for (auto &[k, v] : value) ss << " (" << k << " . " << v->toString() << ")";
-  ss << ")";
-  return ss.str();
-}
+// Single pass text serializer appending into one buffer. The dump form matches what the toString hooks
+// always produced; SNBT keeps enough type and precision information to be parsed back.
+struct NbtPrinter {
+  std::string &out;
+  bool snbt;
+  int maxDepth;
+  size_t maxSize;
 
-TInstanceHook(std::string, _ZNK7ListTag8toStringB5cxx11Ev, ListTag) {
-  std::stringstream ss;
-  ss << "(List";
-  for (auto &v : value) ss << " " << v->toString();
-  ss << ")";
-  return ss.str();
-}
+  void number(char const *format, double value, char const *suffix = "") {
+    char buffer[40];
+    auto length = snprintf(buffer, sizeof buffer, format, value);
+    out.append(buffer, length);
+    out.append(suffix);
+  }
 
-TInstanceHook(std::string, _ZNK9DoubleTag8toStringB5cxx11Ev, DoubleTag) {
-  std::stringstream ss;
-  ss << "(Double " << value << ")";
-  return ss.str();
-}
+  void integer(int64_t value, char const *suffix = "") {
+    char buffer[24];
+    auto length = snprintf(buffer, sizeof buffer, "%lld", (long long)value);
+    out.append(buffer, length);
+    out.append(suffix);
+  }
 
-TInstanceHook(std::string, _ZNK8ShortTag8toStringB5cxx11Ev, ShortTag) {
-  std::stringstream ss;
-  ss << "(Short " << value << ")";
-  return ss.str();
-}
+  void string(std::string const &str) {
+    out += '"';
+    for (auto ch : str) {
+      switch (ch) {
+      case '\\': out += "\\\\"; break;
+      case '"': out += "\\\""; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '/':
+        if (!snbt) {
+          out += "\\/";
+          break;
+        }
+        [[fallthrough]];
+      default: out += ch; break;
+      }
+    }
+    out += '"';
+  }
+
+  void key(std::string const &str) {
+    if (!snbt) {
+      out.append(str);
+      return;
+    }
+    bool bare = !str.empty();
+    for (auto ch : str) bare = bare && (isalnum((unsigned char)ch) || ch == '_' || ch == '-' || ch == '.' || ch == '+');
+    if (bare)
+      out.append(str);
+    else
+      string(str);
+  }
 
-TInstanceHook(std::string, _ZNK8Int64Tag8toStringB5cxx11Ev, Int64Tag) {
-  std::stringstream ss;
-  ss << "(Int64 " << value << ")";
-  return ss.str();
+  void print(Tag const &tag, int depth = 0) {
+    if (depth > maxDepth || out.size() > maxSize) {
+      out += "...";
+      return;
+    }
+    switch (tag.getId()) {
+    case TAG_BYTE:
+      if (snbt)
+        integer((signed char)((ByteTag const &)tag).value, "b");
+      else {
+        out += "(Byte ";
+        integer(((ByteTag const &)tag).value, ")");
+      }
+      break;
+    case TAG_SHORT:
+      if (!snbt) out += "(Short ";
+      integer(((ShortTag const &)tag).value, snbt ? "s" : ")");
+      break;
+    case TAG_INT:
+      if (!snbt) out += "(Int ";
+      integer(((IntTag const &)tag).value, snbt ? "" : ")");
+      break;
+    case TAG_INT64:
+      if (!snbt) out += "(Int64 ";
+      integer(((Int64Tag const &)tag).value, snbt ? "L" : ")");
+      break;
+    case TAG_FLOAT:
+      if (!snbt) out += "(Float ";
+      number(snbt ? "%.9g" : "%g", ((FloatTag const &)tag).value, snbt ? "f" : ")");
+      break;
+    case TAG_DOUBLE:
+      if (!snbt) out += "(Double ";
+      number(snbt ? "%.17g" : "%g", ((DoubleTag const &)tag).value, snbt ? "d" : ")");
+      break;
+    case TAG_STRING: string(((StringTag const &)tag).value); break;
+    case TAG_BYTEARRAY: {
+      if (!snbt) {
+        out += "(ByteArray)";
+        break;
+      }
+      auto &chunk = ((ByteArrayTag const &)tag).value;
+      out += "[B;";
+      for (size_t i = 0; i < chunk.m_size; i++) {
+        if (i) out += ',';
+        integer((signed char)chunk.m_data[i], "b");
+      }
+      out += ']';
+    } break;
+    case TAG_INTARRAY: {
+      if (!snbt) {
+        out += "(IntArray)";
+        break;
+      }
+      auto &chunk = ((IntArrayTag const &)tag).value;
+      auto data   = (int32_t const *)chunk.m_data.get();
+      out += "[I;";
+      for (size_t i = 0; i < chunk.m_size / sizeof(int32_t); i++) {
+        if (i) out += ',';
+        integer(data[i]);
+      }
+      out += ']';
+    } break;
+    case TAG_LIST: {
+      out += snbt ? "[" : "(List";
+      bool first = true;
+      for (auto &item : ((ListTag const &)tag).value) {
+        out += snbt ? (first ? "" : ",") : " ";
+        first = false;
+        print(*item, depth + 1);
+      }
+      out += snbt ? "]" : ")";
+    } break;
+    case TAG_COMPOUND: {
+      out += snbt ? "{" : "(Compound";
+      bool first = true;
+      for (auto &[k, v] : ((CompoundTag const &)tag).value) {
+        if (!v) continue;
+        out += snbt ? (first ? "" : ",") : " (";
+        first = false;
+        key(k);
+        out += snbt ? ":" : " . ";
+        print(*v, depth + 1);
+        if (!snbt) out += ')';
+      }
+      out += snbt ? "}" : ")";
+    } break;
+    }
+  }
+};
+
+void formatNbt(Tag const &tag, std::string &out, bool snbt, int maxDepth, size_t maxSize) {
+  out.reserve(out.size() + 256);
+  NbtPrinter{ out, snbt, maxDepth, maxSize }.print(tag);
 }
 
-TInstanceHook(std::string, _ZNK8FloatTag8toStringB5cxx11Ev, FloatTag) {
-  std::stringstream ss;
-  ss << "(Float " << value << ")";
-  return ss.str();
+static std::string dumpTag(Tag const &tag) {
+  std::string out;
+  formatNbt(tag, out);
+  return out;
 }
 
-TInstanceHook(std::string, _ZNK6IntTag8toStringB5cxx11Ev, IntTag) {
-  std::stringstream ss;
-  ss << "(Int " << value << ")";
-  return ss.str();
+TInstanceHook(std::string, _ZNK11CompoundTag8toStringB5cxx11Ev, CompoundTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK7ListTag8toStringB5cxx11Ev, ListTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK9DoubleTag8toStringB5cxx11Ev, DoubleTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK8ShortTag8toStringB5cxx11Ev, ShortTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK8Int64Tag8toStringB5cxx11Ev, Int64Tag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK8FloatTag8toStringB5cxx11Ev, FloatTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK6IntTag8toStringB5cxx11Ev, IntTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK7ByteTag8toStringB5cxx11Ev, ByteTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK11IntArrayTag8toStringB5cxx11Ev, IntArrayTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK12ByteArrayTag8toStringB5cxx11Ev, ByteArrayTag) { return dumpTag(*this); }
+TInstanceHook(std::string, _ZNK9StringTag8toStringB5cxx11Ev, StringTag) { return dumpTag(*this); }
+
+SCM_DEFINE_PUBLIC(c_actor_nbt, "actor-nbt", 1, 0, 0, (scm::val<Actor *> act), "Actor's NBT") {
+  CompoundTag *tag = new CompoundTag;
+  if (!act->save(*tag)) { return SCM_BOOL_F; }
+  return scm::to_scm(tag);
 }
 
-TInstanceHook(std::string, _ZNK7ByteTag8toStringB5cxx11Ev, ByteTag) {
-  std::stringstream ss;
-  ss << "(Byte " << (int)value << ")";
-  return ss.str();
+static void closeTree(SCM handle) { nbtRootOf(handle)->close(); }
+
+SCM_DEFINE_PUBLIC(c_nbt_close, "nbt-close", 1, 0, 0, (SCM tag),
+                  "Free NBT tree now instead of when its handles are collected (closing twice is harmless)") {
+  SCM_ASSERT_TYPE(isNbtHandle(tag), tag, 1, "nbt-close", "nbt");
+  closeTree(tag);
+  return SCM_UNSPECIFIED;
 }
 
-TInstanceHook(std::string, _ZNK11IntArrayTag8toStringB5cxx11Ev, IntArrayTag) {
-  std::stringstream ss;
-  ss << "(IntArray)";
-  return ss.str();
+SCM_DEFINE_PUBLIC(c_with_nbt, "with-nbt", 2, 0, 0, (scm::val<Tag *> tag, SCM cb), "Call cb with tag and free the tree afterwards") {
+  tag.get();
+  auto ret = scm_call_1(cb, tag.scm);
+  closeTree(tag.scm);
+  return ret;
 }
 
-TInstanceHook(std::string, _ZNK12ByteArrayTag8toStringB5cxx11Ev, ByteArrayTag) {
-  std::stringstream ss;
-  ss << "(ByteArray)";
-  return ss.str();
+SCM_DEFINE_PUBLIC(nbt_dump, "nbt-dump", 1, 2, 0, (scm::val<Tag *> tag, scm::val<int> depth, scm::val<size_t> size),
+                  "Dump nbt (optionally capped at depth and output size)") {
+  std::string out;
+  formatNbt(*tag.get(), out, false, depth[INT_MAX], size[SIZE_MAX]);
+  return scm::to_scm(out);
 }
 
-TInstanceHook(std::string, _ZNK9StringTag8toStringB5cxx11Ev, StringTag) {
-  std::stringstream ss;
-  ss << "\"";
-  for (auto &ch : value) {
-    switch (ch) {
-    case '\\': ss << "\\\\"; break;
-    case '"': ss << "\\\""; break;
-    case '/': ss << "\\/"; break;
-    case '\b': ss << "\\b"; break;
-    case '\f': ss << "\\f"; break;
-    case '\n': ss << "\\n"; break;
-    case '\r': ss << "\\r"; break;
-    case '\t': ss << "\\t"; break;
-    default: ss << ch; break;
-    }
-  }
-  ss << "\"";
-  return ss.str();
+SCM_DEFINE_PUBLIC(nbt_to_snbt, "nbt->snbt", 1, 0, 0, (scm::val<Tag *> tag), "Format nbt as SNBT text") {
+  std::string out;
+  formatNbt(*tag.get(), out, true);
+  return scm::to_scm(out);
 }
 
-SCM_DEFINE_PUBLIC(c_actor_nbt, "actor-nbt", 1, 0, 0, (scm::val<Actor *> act), "Actor's NBT") {
-  CompoundTag *tag = new CompoundTag;
-  if (!act->save(*tag)) { return SCM_BOOL_F; }
-  return scm::to_scm(tag);
+template <typename T> static SCM copyArray(TagMemoryChunk const &chunk) {
+  scm::vector<T> vec{ chunk.m_size / sizeof(T) };
+  vec <<= [&](T *el, size_t l) {
+    if (l) memcpy(el, chunk.m_data.get(), l * sizeof(T));
+  };
+  return vec;
 }
 
-SCM_DEFINE_PUBLIC(c_nbt_close, "nbt-close", 1, 0, 0, (scm::val<Tag *> tag), "Close NBT instance") {
-  delete tag.get();
-  return SCM_UNSPECIFIED;
+// Pins the tree for one array view; the weak table drops it (and its finalizer runs) once the view is gone
+struct NbtViewGuard {
+  NbtRoot *root;
+  Tag const *tag;
+};
+
+namespace scm {
+template <> struct convertible<NbtViewGuard *> : foreign_object_is_convertible<NbtViewGuard *> {};
+} // namespace scm
+
+MAKE_FOREIGN_TYPE(NbtViewGuard *, "nbt-array-view-guard", [](SCM s) {
+  auto guard = (NbtViewGuard *)scm_foreign_object_ref(s, 0);
+  guard->root->releaseView(guard->tag);
+  delete guard;
+});
+
+static SCM arrayViews = SCM_BOOL_F;
+
+template <typename T> static SCM viewArray(SCM owner, Tag const *tag, TagMemoryChunk &chunk, char const *type) {
+  // pointer->bytevector rejects null, an empty array has nothing to alias anyway
+  if (!chunk.m_data || chunk.m_size < sizeof(T)) return copyArray<T>(chunk);
+  if (scm_is_false(arrayViews)) arrayViews = scm_permanent_object(scm_make_weak_key_hash_table(SCM_UNDEFINED));
+  auto root = nbtRootOf(owner);
+  SCM view  = scm_pointer_to_bytevector(scm_from_pointer(chunk.m_data.get(), nullptr), scm::to_scm(chunk.m_size / sizeof(T) * sizeof(T)), SCM_INUM0,
+                                       scm_from_utf8_symbol(type));
+  root->acquire(tag);
+  root->views++;
+  scm_hashq_set_x(arrayViews, view, scm::to_scm(new NbtViewGuard{ root, tag }));
+  return view;
 }
 
-SCM_DEFINE_PUBLIC(c_with_nbt, "with-nbt", 2, 0, 0, (scm::val<Tag *> tag, scm::callback<SCM, Tag *> cb), "Auto managed NBT") {
-  auto ret = cb(tag);
-  delete tag;
-  return ret;
+SCM_DEFINE_PUBLIC(c_nbt_array_view, "nbt-array-view", 1, 0, 0, (SCM tag),
+                  "View IntArray/ByteArray contents as s32vector/u8vector without copying (the tree outlives nbt-close while views exist)") {
+  if (SCM_IS_A_P(tag, scm::foreign_type_convertible<IntArrayTag *>::type())) {
+    auto array = scm::from_scm<IntArrayTag *>(tag);
+    return viewArray<int>(tag, array, array->value, "s32");
+  }
+  auto array = scm::from_scm<ByteArrayTag *>(tag);
+  return viewArray<unsigned char>(tag, array, array->value, "u8");
 }
 
-SCM_DEFINE_PUBLIC(nbt_dump, "nbt-dump", 1, 0, 0, (scm::val<Tag *> tag), "Dump nbt") { return scm::to_scm(tag->toString()); }
+SCM_DEFINE_PUBLIC(c_nbt_array_copy, "nbt-array-copy", 1, 0, 0, (SCM tag), "Copy IntArray/ByteArray contents into a fresh s32vector/u8vector") {
+  if (SCM_IS_A_P(tag, scm::foreign_type_convertible<IntArrayTag *>::type())) return copyArray<int>(scm::from_scm<IntArrayTag *>(tag)->value);
+  return copyArray<unsigned char>(scm::from_scm<ByteArrayTag *>(tag)->value);
+}
 
 SCM unbox(Tag *tag) {
-#define CASE(T) if (auto target = dynamic_cast<T *>(tag); target)
+  if (!tag) return SCM_BOOL_F;
+#define CASE(T) case tagTypeOf<T>: if (auto target = static_cast<T *>(tag); true)
+  switch (tag->getId()) {
   CASE(CompoundTag) {
     SCM list = SCM_EOL;
     for (auto &[k, v] : target->value) { list = scm_cons(scm_cons(scm::to_scm(k), unbox(v.get())), list); }
@@ -130,15 +288,8 @@ SCM unbox(Tag *tag) {
   CASE(FloatTag) { return scm::to_scm(target->value); }
   CASE(IntTag) { return scm::to_scm(target->value); }
   CASE(ByteTag) { return scm::to_scm(target->value); }
-  CASE(IntArrayTag) {
-    scm::vector<int> vec{ target->value.m_size / sizeof(int) };
-    vec <<= [&](int *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return vec;
-  }
-  CASE(ByteArrayTag) {
-    scm::vector<unsigned char> vec{ target->value.m_size / sizeof(unsigned char) };
-    vec <<= [&](unsigned char *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return vec;
+  CASE(IntArrayTag) { return copyArray<int>(target->value); }
+  CASE(ByteArrayTag) { return copyArray<unsigned char>(target->value); }
   }
 #undef CASE
   return SCM_BOOL_F;
@@ -155,19 +306,22 @@ SCM_DEFINE_PUBLIC(c_nbt_compound_keys, "nbt-compound-keys", 1, 0, 0, (scm::val<C
 }
 
 SCM_DEFINE_PUBLIC(c_nbt_compound_ref, "nbt-compound-ref", 2, 0, 0, (scm::val<CompoundTag *> tag, scm::val<std::string> key), "Get CompoundTag ref") {
-  return scm::to_scm(tag->value[key].get());
+  auto it = tag->value.find(key);
+  return it != tag->value.end() ? nbtChild(tag.scm, it->second.get()) : SCM_BOOL_F;
 }
 
 SCM_DEFINE_PUBLIC(c_nbt_shadow_unbox, "nbt-unbox", 1, 0, 0, (scm::val<Tag *> tag), "Unbox NBT") {
-#define CASE(T) if (auto target = dynamic_cast<T *>(tag.get()); target)
+  if (!tag.get()) return SCM_BOOL_F;
+#define CASE(T) case tagTypeOf<T>: if (auto target = static_cast<T *>(tag.get()); true)
+  switch (tag->getId()) {
   CASE(CompoundTag) {
     SCM list = SCM_EOL;
-    for (auto &[k, v] : target->value) { list = scm_cons(scm_cons(scm::to_scm(k), scm::to_scm(v.get())), list); }
+    for (auto &[k, v] : target->value) { list = scm_cons(scm_cons(scm::to_scm(k), nbtChild(tag.scm, v.get())), list); }
     return scm_reverse(list);
   }
   CASE(ListTag) {
     SCM list = SCM_EOL;
-    for (auto &v : target->value) { list = scm_cons(scm::to_scm(v.get()), list); }
+    for (auto &v : target->value) { list = scm_cons(nbtChild(tag.scm, v.get()), list); }
     return scm_reverse(list);
   }
   CASE(StringTag) { return scm::to_scm(target->value); }
@@ -177,15 +331,8 @@ SCM_DEFINE_PUBLIC(c_nbt_shadow_unbox, "nbt-unbox", 1, 0, 0, (scm::val<Tag *> tag
   CASE(FloatTag) { return scm::to_scm(target->value); }
   CASE(IntTag) { return scm::to_scm(target->value); }
   CASE(ByteTag) { return scm::to_scm(target->value); }
-  CASE(IntArrayTag) {
-    scm::vector<int> vec{ target->value.m_size / sizeof(int) };
-    vec <<= [&](int *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return vec;
-  }
-  CASE(ByteArrayTag) {
-    scm::vector<unsigned char> vec{ target->value.m_size / sizeof(unsigned char) };
-    vec <<= [&](unsigned char *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return vec;
+  CASE(IntArrayTag) { return copyArray<int>(target->value); }
+  CASE(ByteArrayTag) { return copyArray<unsigned char>(target->value); }
   }
 #undef CASE
   return SCM_BOOL_F;
@@ -204,7 +351,9 @@ SCM_SYMBOL(intarray_tag, "intarray");
 SCM_SYMBOL(bytearray_tag, "bytearray");
 
 SCM unbox_with_tag(Tag *tag) {
-#define CASE(T) if (auto target = dynamic_cast<T *>(tag); target)
+  if (!tag) return SCM_BOOL_F;
+#define CASE(T) case tagTypeOf<T>: if (auto target = static_cast<T *>(tag); true)
+  switch (tag->getId()) {
   CASE(CompoundTag) {
     SCM list = SCM_EOL;
     for (auto &[k, v] : target->value) { list = scm_cons(scm_cons(scm::to_scm(k), unbox_with_tag(v.get())), list); }
@@ -222,15 +371,8 @@ SCM unbox_with_tag(Tag *tag) {
   CASE(FloatTag) { return scm_cons(float_tag, scm::to_scm(target->value)); }
   CASE(IntTag) { return scm_cons(int_tag, scm::to_scm(target->value)); }
   CASE(ByteTag) { return scm_cons(byte_tag, scm::to_scm(target->value)); }
-  CASE(IntArrayTag) {
-    scm::vector<int> vec{ target->value.m_size / sizeof(int) };
-    vec <<= [&](int *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return scm_cons(intarray_tag, vec);
-  }
-  CASE(ByteArrayTag) {
-    scm::vector<unsigned char> vec{ target->value.m_size / sizeof(unsigned char) };
-    vec <<= [&](unsigned char *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return scm_cons(bytearray_tag, vec);
+  CASE(IntArrayTag) { return scm_cons(intarray_tag, copyArray<int>(target->value)); }
+  CASE(ByteArrayTag) { return scm_cons(bytearray_tag, copyArray<unsigned char>(target->value)); }
   }
 #undef CASE
   return SCM_BOOL_F;
@@ -241,15 +383,17 @@ SCM_DEFINE_PUBLIC(c_nbt_unbox_with_tag, "nbt-unbox-rec/tag", 1, 0, 0, (scm::val<
 }
 
 SCM_DEFINE_PUBLIC(c_nbt_shadow_unbox_tag, "nbt-unbox/tag", 1, 0, 0, (scm::val<Tag *> tag), "Unbox NBT") {
-#define CASE(T) if (auto target = dynamic_cast<T *>(tag.get()); target)
+  if (!tag.get()) return SCM_BOOL_F;
+#define CASE(T) case tagTypeOf<T>: if (auto target = static_cast<T *>(tag.get()); true)
+  switch (tag->getId()) {
   CASE(CompoundTag) {
     SCM list = SCM_EOL;
-    for (auto &[k, v] : target->value) { list = scm_cons(scm_cons(scm::to_scm(k), scm::to_scm(v.get())), list); }
+    for (auto &[k, v] : target->value) { list = scm_cons(scm_cons(scm::to_scm(k), nbtChild(tag.scm, v.get())), list); }
     return scm_cons(compound_tag, scm_reverse(list));
   }
   CASE(ListTag) {
     SCM list = SCM_EOL;
-    for (auto &v : target->value) { list = scm_cons(scm::to_scm(v.get()), list); }
+    for (auto &v : target->value) { list = scm_cons(nbtChild(tag.scm, v.get()), list); }
     return scm_cons(list_tag, scm_reverse(list));
   }
   CASE(StringTag) { return scm_cons(string_tag, scm::to_scm(target->value)); }
@@ -259,20 +403,827 @@ SCM_DEFINE_PUBLIC(c_nbt_shadow_unbox_tag, "nbt-unbox/tag", 1, 0, 0, (scm::val<Ta
   CASE(FloatTag) { return scm_cons(float_tag, scm::to_scm(target->value)); }
   CASE(IntTag) { return scm_cons(int_tag, scm::to_scm(target->value)); }
   CASE(ByteTag) { return scm_cons(byte_tag, scm::to_scm(target->value)); }
-  CASE(IntArrayTag) {
-    scm::vector<int> vec{ target->value.m_size / sizeof(int) };
-    vec <<= [&](int *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return scm_cons(intarray_tag, vec);
-  }
-  CASE(ByteArrayTag) {
-    scm::vector<unsigned char> vec{ target->value.m_size / sizeof(unsigned char) };
-    vec <<= [&](unsigned char *el, size_t l) { memccpy(el, target->value.data(), 1, target->value.m_size); };
-    return scm_cons(bytearray_tag, vec);
+  CASE(IntArrayTag) { return scm_cons(intarray_tag, copyArray<int>(target->value)); }
+  CASE(ByteArrayTag) { return scm_cons(bytearray_tag, copyArray<unsigned char>(target->value)); }
   }
 #undef CASE
   return SCM_BOOL_F;
 }
 
+// Empty lists keep the element type they were created or read with
+static unsigned char elementType(ListTag const &list) { return list.value.empty() ? list.unk : list.value.front()->getId(); }
+
+// Strings longer than the u16 length prefix can hold make the whole write fail
+struct NbtWriter {
+  std::string &out;
+  bool ok = true;
+
+  template <typename T> void put(T value) { out.append((char const *)&value, sizeof value); }
+
+  void string(std::string const &str) {
+    if (str.size() > UINT16_MAX) {
+      ok = false;
+      return;
+    }
+    put<uint16_t>(str.size());
+    out.append(str);
+  }
+
+  void payload(Tag const &tag) {
+    switch (tag.getId()) {
+    case TAG_BYTE: put(((ByteTag const &)tag).value); break;
+    case TAG_SHORT: put(((ShortTag const &)tag).value); break;
+    case TAG_INT: put(((IntTag const &)tag).value); break;
+    case TAG_INT64: put(((Int64Tag const &)tag).value); break;
+    case TAG_FLOAT: put(((FloatTag const &)tag).value); break;
+    case TAG_DOUBLE: put(((DoubleTag const &)tag).value); break;
+    case TAG_STRING: string(((StringTag const &)tag).value); break;
+    case TAG_BYTEARRAY: {
+      auto &chunk = ((ByteArrayTag const &)tag).value;
+      put<int32_t>(chunk.m_size);
+      out.append((char const *)chunk.m_data.get(), chunk.m_size);
+    } break;
+    case TAG_INTARRAY: {
+      auto &chunk = ((IntArrayTag const &)tag).value;
+      put<int32_t>(chunk.m_size / sizeof(int32_t));
+      out.append((char const *)chunk.m_data.get(), chunk.m_size / sizeof(int32_t) * sizeof(int32_t));
+    } break;
+    case TAG_LIST: {
+      auto &list = ((ListTag const &)tag).value;
+      put<uint8_t>(elementType((ListTag const &)tag));
+      put<int32_t>(list.size());
+      for (auto &item : list) payload(*item);
+    } break;
+    case TAG_COMPOUND: {
+      for (auto &[key, value] : ((CompoundTag const &)tag).value) {
+        if (!value) continue;
+        put<uint8_t>(value->getId());
+        string(key);
+        payload(*value);
+      }
+      put<uint8_t>(TAG_END);
+    } break;
+    }
+  }
+};
+
+bool writeNbt(Tag const &tag, std::string &out, std::string const &name) {
+  NbtWriter writer{ out };
+  writer.put<uint8_t>(tag.getId());
+  writer.string(name);
+  writer.payload(tag);
+  return writer.ok;
+}
+
+// Bounds checked decoder, malformed input yields nullptr instead of reading past the buffer
+struct NbtReader {
+  static constexpr int maxDepth = 512;
+
+  char const *data, *end;
+
+  template <typename T> bool get(T &value) {
+    if (end - data < (ptrdiff_t)sizeof value) return false;
+    memcpy(&value, data, sizeof value);
+    data += sizeof value;
+    return true;
+  }
+
+  bool string(std::string &str) {
+    uint16_t length;
+    if (!get(length) || end - data < length) return false;
+    str.assign(data, length);
+    data += length;
+    return true;
+  }
+
+  bool chunk(TagMemoryChunk &chunk, size_t element) {
+    int32_t count;
+    if (!get(count) || count < 0 || (size_t)(end - data) / element < (size_t)count) return false;
+    chunk.m_size = chunk.m_cap = count * element;
+    chunk.m_data = std::make_unique<unsigned char[]>(chunk.m_size);
+    memcpy(chunk.m_data.get(), data, chunk.m_size);
+    data += chunk.m_size;
+    return true;
+  }
+
+  template <typename T> std::unique_ptr<Tag> scalar() {
+    auto tag = std::make_unique<T>();
+    if (!get(tag->value)) return nullptr;
+    return tag;
+  }
+
+  std::unique_ptr<Tag> payload(uint8_t type, int depth) {
+    if (depth > maxDepth) return nullptr;
+    switch (type) {
+    case TAG_BYTE: return scalar<ByteTag>();
+    case TAG_SHORT: return scalar<ShortTag>();
+    case TAG_INT: return scalar<IntTag>();
+    case TAG_INT64: return scalar<Int64Tag>();
+    case TAG_FLOAT: return scalar<FloatTag>();
+    case TAG_DOUBLE: return scalar<DoubleTag>();
+    case TAG_STRING: {
+      auto tag = std::make_unique<StringTag>();
+      if (!string(tag->value)) return nullptr;
+      return tag;
+    }
+    case TAG_BYTEARRAY: {
+      auto tag = std::make_unique<ByteArrayTag>();
+      if (!chunk(tag->value, 1)) return nullptr;
+      return tag;
+    }
+    case TAG_INTARRAY: {
+      auto tag = std::make_unique<IntArrayTag>();
+      if (!chunk(tag->value, sizeof(int32_t))) return nullptr;
+      return tag;
+    }
+    case TAG_LIST: {
+      uint8_t element;
+      int32_t count;
+      if (!get(element) || !get(count) || count < 0 || count > end - data) return nullptr; // every element takes at least a byte
+      auto tag = std::make_unique<ListTag>();
+      tag->unk = element;
+      tag->value.reserve(count);
+      for (int32_t i = 0; i < count; i++) {
+        auto item = payload(element, depth + 1);
+        if (!item) return nullptr;
+        tag->value.emplace_back(std::move(item));
+      }
+      return tag;
+    }
+    case TAG_COMPOUND: {
+      auto tag = std::make_unique<CompoundTag>();
+      uint8_t element;
+      std::string key;
+      while (get(element)) {
+        if (element == TAG_END) return tag;
+        if (!string(key)) return nullptr;
+        auto item = payload(element, depth + 1);
+        if (!item) return nullptr;
+        tag->value[key] = std::move(item);
+      }
+      return nullptr;
+    }
+    }
+    return nullptr;
+  }
+};
+
+std::unique_ptr<Tag> readNbt(char const *data, size_t size, std::string *name) {
+  NbtReader reader{ data, data + size };
+  uint8_t type;
+  std::string key;
+  if (!reader.get(type) || !reader.string(key)) return nullptr;
+  if (name) *name = key;
+  return reader.payload(type, 0);
+}
+
+// Builds a tree from the form nbt-unbox-rec/tag produces. Errors are collected instead of raised
+// so the partial tree is released before control leaves C++.
+struct NbtBuilder {
+  SCM error = SCM_BOOL_F;
+
+  std::unique_ptr<Tag> fail(char const *message, SCM form) {
+    if (scm_is_false(error)) error = scm_list_2(scm_from_utf8_string(message), form);
+    return nullptr;
+  }
+
+  template <typename T> std::unique_ptr<Tag> integer(SCM value, int64_t min, int64_t max) {
+    if (!scm_is_signed_integer(value, min, max)) return fail("integer out of range", value);
+    auto tag   = std::make_unique<T>();
+    tag->value = scm_to_int64(value);
+    return tag;
+  }
+
+  template <typename T> std::unique_ptr<Tag> real(SCM value) {
+    if (!scm_is_real(value)) return fail("not a real number", value);
+    auto tag   = std::make_unique<T>();
+    tag->value = scm_to_double(value);
+    return tag;
+  }
+
+  template <typename T> std::unique_ptr<Tag> array(SCM value, size_t element) {
+    if (!scm_is_bytevector(value) || SCM_BYTEVECTOR_LENGTH(value) % element) return fail("not a matching uniform vector", value);
+    auto tag    = std::make_unique<T>();
+    auto &chunk = tag->value;
+    chunk.m_size = chunk.m_cap = SCM_BYTEVECTOR_LENGTH(value);
+    chunk.m_data = std::make_unique<unsigned char[]>(chunk.m_size);
+    memcpy(chunk.m_data.get(), SCM_BYTEVECTOR_CONTENTS(value), chunk.m_size);
+    return tag;
+  }
+
+  std::unique_ptr<Tag> build(SCM form) {
+    if (!scm_is_pair(form)) return fail("not a tagged nbt form", form);
+    SCM type = SCM_CAR(form), value = SCM_CDR(form);
+    if (scm_is_eq(type, compound_tag)) {
+      auto tag = std::make_unique<CompoundTag>();
+      for (; scm_is_pair(value); value = SCM_CDR(value)) {
+        SCM entry = SCM_CAR(value);
+        if (!scm_is_pair(entry) || !scm_is_string(SCM_CAR(entry))) return fail("not a compound entry", entry);
+        auto item = build(SCM_CDR(entry));
+        if (!item) return nullptr;
+        tag->value[scm::from_scm<std::string>(SCM_CAR(entry))] = std::move(item);
+      }
+      return tag;
+    }
+    if (scm_is_eq(type, list_tag)) {
+      auto tag = std::make_unique<ListTag>();
+      tag->unk = TAG_END;
+      for (; scm_is_pair(value); value = SCM_CDR(value)) {
+        auto item = build(SCM_CAR(value));
+        if (!item) return nullptr;
+        if (tag->value.empty()) tag->unk = item->getId();
+        if (item->getId() != tag->unk) return fail("mixed element types in list", form);
+        tag->value.emplace_back(std::move(item));
+      }
+      return tag;
+    }
+    if (scm_is_eq(type, string_tag)) {
+      if (!scm_is_string(value)) return fail("not a string", value);
+      auto tag   = std::make_unique<StringTag>();
+      tag->value = scm::from_scm<std::string>(value);
+      return tag;
+    }
+    if (scm_is_eq(type, byte_tag)) return integer<ByteTag>(value, -128, 255);
+    if (scm_is_eq(type, short_tag)) return integer<ShortTag>(value, INT16_MIN, INT16_MAX);
+    if (scm_is_eq(type, int_tag)) return integer<IntTag>(value, INT32_MIN, INT32_MAX);
+    if (scm_is_eq(type, int64_tag)) return integer<Int64Tag>(value, INT64_MIN, INT64_MAX);
+    if (scm_is_eq(type, float_tag)) return real<FloatTag>(value);
+    if (scm_is_eq(type, double_tag)) return real<DoubleTag>(value);
+    if (scm_is_eq(type, bytearray_tag)) return array<ByteArrayTag>(value, 1);
+    if (scm_is_eq(type, intarray_tag)) return array<IntArrayTag>(value, sizeof(int32_t));
+    return fail("unknown tag type", type);
+  }
+};
+
+SCM_DEFINE_PUBLIC(c_scm_to_nbt, "scm->nbt", 1, 0, 0, (SCM form), "Build NBT from the tagged form of nbt-unbox-rec/tag") {
+  NbtBuilder builder;
+  auto tag = builder.build(form);
+  if (!tag) scm_misc_error("scm->nbt", "~A: ~S", builder.error);
+  return scm::to_scm(tag.release());
+}
+
+// Parses the SNBT written by nbt->snbt, plus the usual relaxations: unquoted string values,
+// true/false and case-insensitive suffixes
+struct SnbtParser {
+  static constexpr int maxDepth = 512;
+
+  char const *begin, *data, *end;
+  char const *error = nullptr;
+
+  std::unique_ptr<Tag> fail(char const *message) {
+    if (!error) error = message;
+    return nullptr;
+  }
+
+  void skip() {
+    while (data < end && isspace((unsigned char)*data)) data++;
+  }
+
+  bool eat(char ch) {
+    skip();
+    if (data < end && *data == ch) {
+      data++;
+      return true;
+    }
+    return false;
+  }
+
+  static bool bareChar(char ch) { return isalnum((unsigned char)ch) || ch == '_' || ch == '-' || ch == '.' || ch == '+'; }
+
+  bool string(std::string &out) {
+    skip();
+    out.clear();
+    if (data < end && (*data == '"' || *data == '\'')) {
+      char quote = *data++;
+      while (data < end && *data != quote) {
+        char ch = *data++;
+        if (ch == '\\' && data < end) {
+          ch = *data++;
+          switch (ch) {
+          case 'n': ch = '\n'; break;
+          case 'r': ch = '\r'; break;
+          case 't': ch = '\t'; break;
+          case 'b': ch = '\b'; break;
+          case 'f': ch = '\f'; break;
+          }
+        }
+        out += ch;
+      }
+      if (data == end) return false;
+      data++;
+      return true;
+    }
+    auto start = data;
+    while (data < end && bareChar(*data)) data++;
+    out.assign(start, data);
+    return !out.empty();
+  }
+
+  // Bare words are numbers when they look like one, strings otherwise
+  std::unique_ptr<Tag> scalar(std::string const &word) {
+    if (word == "true" || word == "false") {
+      auto tag   = std::make_unique<ByteTag>();
+      tag->value = word == "true";
+      return tag;
+    }
+    char suffix = tolower((unsigned char)word.back());
+    auto digits = word;
+    if (strchr("bslfd", suffix)) digits.pop_back();
+    char *stop;
+    errno = 0;
+    bool isReal = digits.find_first_of(".eE") != std::string::npos || suffix == 'f' || suffix == 'd';
+    if (!digits.empty() && !isReal) {
+      auto value = strtoll(digits.c_str(), &stop, 10);
+      if (*stop == 0 && errno == 0) {
+        switch (suffix) {
+        case 'b': {
+          if (value < -128 || value > 255) return fail("byte out of range");
+          auto tag   = std::make_unique<ByteTag>();
+          tag->value = value;
+          return tag;
+        }
+        case 's': {
+          if (value < INT16_MIN || value > INT16_MAX) return fail("short out of range");
+          auto tag   = std::make_unique<ShortTag>();
+          tag->value = value;
+          return tag;
+        }
+        case 'l': {
+          auto tag   = std::make_unique<Int64Tag>();
+          tag->value = value;
+          return tag;
+        }
+        default: {
+          if (value < INT32_MIN || value > INT32_MAX) return fail("int out of range");
+          auto tag   = std::make_unique<IntTag>();
+          tag->value = value;
+          return tag;
+        }
+        }
+      }
+    } else if (!digits.empty() && (isdigit((unsigned char)digits[0]) || strchr("+-.", digits[0]))) {
+      auto value = strtod(digits.c_str(), &stop);
+      if (*stop == 0) {
+        if (suffix == 'f') {
+          auto tag   = std::make_unique<FloatTag>();
+          tag->value = value;
+          return tag;
+        }
+        auto tag   = std::make_unique<DoubleTag>();
+        tag->value = value;
+        return tag;
+      }
+    }
+    auto tag   = std::make_unique<StringTag>();
+    tag->value = word;
+    return tag;
+  }
+
+  template <typename T, typename E> std::unique_ptr<Tag> array(TagType element) {
+    std::vector<E> items;
+    if (!eat(']')) {
+      do {
+        auto item = value(maxDepth);
+        if (!item || item->getId() != element) return fail("bad array element");
+        items.push_back(element == TAG_BYTE ? ((ByteTag *)item.get())->value : ((IntTag *)item.get())->value);
+      } while (eat(','));
+      if (!eat(']')) return fail("expected ]");
+    }
+    return make<T, E>(items);
+  }
+
+  template <typename T, typename E> static std::unique_ptr<Tag> make(std::vector<E> const &items) {
+    auto tag    = std::make_unique<T>();
+    auto &chunk = tag->value;
+    chunk.m_size = chunk.m_cap = items.size() * sizeof(E);
+    chunk.m_data = std::make_unique<unsigned char[]>(chunk.m_size);
+    memcpy(chunk.m_data.get(), items.data(), chunk.m_size);
+    return tag;
+  }
+
+  std::unique_ptr<Tag> value(int depth) {
+    if (depth > maxDepth) return fail("nesting too deep");
+    skip();
+    if (data == end) return fail("unexpected end");
+    if (eat('{')) {
+      auto tag = std::make_unique<CompoundTag>();
+      if (eat('}')) return tag;
+      std::string key;
+      do {
+        if (!string(key)) return fail("expected key");
+        if (!eat(':')) return fail("expected :");
+        auto item = value(depth + 1);
+        if (!item) return nullptr;
+        tag->value[key] = std::move(item);
+      } while (eat(','));
+      if (!eat('}')) return fail("expected }");
+      return tag;
+    }
+    if (eat('[')) {
+      if (end - data >= 2 && data[1] == ';') {
+        char type = toupper((unsigned char)data[0]);
+        data += 2;
+        if (type == 'B') return array<ByteArrayTag, unsigned char>(TAG_BYTE);
+        if (type == 'I') return array<IntArrayTag, int32_t>(TAG_INT);
+        return fail("unsupported array type");
+      }
+      auto tag = std::make_unique<ListTag>();
+      tag->unk = TAG_END;
+      if (eat(']')) return tag;
+      do {
+        auto item = value(depth + 1);
+        if (!item) return nullptr;
+        if (tag->value.empty()) tag->unk = item->getId();
+        if (item->getId() != tag->unk) return fail("mixed element types in list");
+        tag->value.emplace_back(std::move(item));
+      } while (eat(','));
+      if (!eat(']')) return fail("expected ]");
+      return tag;
+    }
+    bool quoted = *data == '"' || *data == '\'';
+    std::string word;
+    if (!string(word)) return fail(quoted ? "unterminated string" : "expected value");
+    if (quoted) {
+      auto tag   = std::make_unique<StringTag>();
+      tag->value = std::move(word);
+      return tag;
+    }
+    return scalar(word);
+  }
+};
+
+std::unique_ptr<Tag> parseSnbt(char const *text, size_t size, std::string *error) {
+  SnbtParser parser{ text, text, text + size };
+  auto tag = parser.value(0);
+  if (tag) {
+    parser.skip();
+    if (parser.data != parser.end) tag = parser.fail("trailing characters");
+  }
+  if (!tag && error) *error = std::string(parser.error ? parser.error : "invalid snbt") + " at " + std::to_string(parser.data - parser.begin);
+  return tag;
+}
+
+SCM_DEFINE_PUBLIC(c_snbt_to_nbt, "snbt->nbt", 1, 0, 0, (scm::val<std::string> text), "Parse SNBT text into NBT") {
+  std::string source = text, error;
+  auto tag = parseSnbt(source.data(), source.size(), &error);
+  if (!tag) scm_misc_error("snbt->nbt", "~A", scm_list_1(scm::to_scm(error)));
+  return scm::to_scm(tag.release());
+}
+
+// Paths are compiled once into steps: strings (or symbols) index compounds, integers index lists
+// (negative counts from the end). Walking touches only the nodes on the path.
+struct NbtPath {
+  struct Step {
+    std::string key;
+    long index;
+    bool isIndex;
+  };
+  std::vector<Step> steps;
+};
+
+namespace scm {
+template <> struct convertible<NbtPath *> : foreign_object_is_convertible<NbtPath *> {};
+} // namespace scm
+
+MAKE_FOREIGN_TYPE(NbtPath *, "nbt-path", [](SCM s) { delete (NbtPath *)scm_foreign_object_ref(s, 0); });
+
+static void checkPath(char const *who, SCM segments) {
+  for (SCM it = segments; scm_is_pair(it); it = SCM_CDR(it)) {
+    SCM step = SCM_CAR(it);
+    if (!scm_is_string(step) && !scm_is_symbol(step) && !scm_is_signed_integer(step, LONG_MIN, LONG_MAX))
+      scm_misc_error(who, "Invalid path step: ~S", scm_list_1(step));
+  }
+}
+
+static NbtPath compilePath(SCM segments) {
+  NbtPath path;
+  for (SCM it = segments; scm_is_pair(it); it = SCM_CDR(it)) {
+    SCM step = SCM_CAR(it);
+    if (scm_is_symbol(step)) step = scm_symbol_to_string(step);
+    if (scm_is_string(step))
+      path.steps.push_back({ scm::from_scm<std::string>(step), 0, false });
+    else
+      path.steps.push_back({ {}, scm_to_long(step), true });
+  }
+  return path;
+}
+
+// Either a single compiled path or path steps given inline
+static NbtPath const &resolvePath(char const *who, SCM segments, NbtPath &storage) {
+  if (scm_is_pair(segments) && scm_is_null(SCM_CDR(segments)) && SCM_IS_A_P(SCM_CAR(segments), scm::foreign_type_convertible<NbtPath *>::type()))
+    return *scm::from_scm<NbtPath *>(SCM_CAR(segments));
+  checkPath(who, segments);
+  storage = compilePath(segments);
+  return storage;
+}
+
+static Tag *child(Tag *tag, NbtPath::Step const &step) {
+  if (!tag) return nullptr;
+  if (step.isIndex) {
+    if (tag->getId() != TAG_LIST) return nullptr;
+    auto &list = static_cast<ListTag *>(tag)->value;
+    auto index = step.index < 0 ? (long)list.size() + step.index : step.index;
+    return index >= 0 && index < (long)list.size() ? list[index].get() : nullptr;
+  }
+  if (tag->getId() != TAG_COMPOUND) return nullptr;
+  auto &map = static_cast<CompoundTag *>(tag)->value;
+  auto it   = map.find(step.key);
+  return it != map.end() ? it->second.get() : nullptr;
+}
+
+static Tag *walkPath(Tag *tag, NbtPath const &path, size_t count) {
+  for (size_t i = 0; i < count && tag; i++) tag = child(tag, path.steps[i]);
+  return tag;
+}
+
+// Scalars and strings come back as Scheme values, containers and arrays as tag handles
+static SCM leafToScm(SCM owner, Tag *tag) {
+  if (!tag) return SCM_BOOL_F;
+  switch (tag->getId()) {
+  case TAG_BYTE: return scm::to_scm(static_cast<ByteTag *>(tag)->value);
+  case TAG_SHORT: return scm::to_scm(static_cast<ShortTag *>(tag)->value);
+  case TAG_INT: return scm::to_scm(static_cast<IntTag *>(tag)->value);
+  case TAG_INT64: return scm::to_scm(static_cast<Int64Tag *>(tag)->value);
+  case TAG_FLOAT: return scm::to_scm(static_cast<FloatTag *>(tag)->value);
+  case TAG_DOUBLE: return scm::to_scm(static_cast<DoubleTag *>(tag)->value);
+  case TAG_STRING: return scm::to_scm(static_cast<StringTag *>(tag)->value);
+  }
+  return nbtChild(owner, tag);
+}
+
+static bool assignLeaf(Tag *tag, SCM value) {
+  switch (tag->getId()) {
+  case TAG_BYTE:
+    if (!scm_is_signed_integer(value, -128, 255)) return false;
+    static_cast<ByteTag *>(tag)->value = scm_to_int(value);
+    return true;
+  case TAG_SHORT:
+    if (!scm_is_signed_integer(value, INT16_MIN, INT16_MAX)) return false;
+    static_cast<ShortTag *>(tag)->value = scm_to_int(value);
+    return true;
+  case TAG_INT:
+    if (!scm_is_signed_integer(value, INT32_MIN, INT32_MAX)) return false;
+    static_cast<IntTag *>(tag)->value = scm_to_int(value);
+    return true;
+  case TAG_INT64:
+    if (!scm_is_signed_integer(value, INT64_MIN, INT64_MAX)) return false;
+    static_cast<Int64Tag *>(tag)->value = scm_to_int64(value);
+    return true;
+  case TAG_FLOAT:
+    if (!scm_is_real(value)) return false;
+    static_cast<FloatTag *>(tag)->value = scm_to_double(value);
+    return true;
+  case TAG_DOUBLE:
+    if (!scm_is_real(value)) return false;
+    static_cast<DoubleTag *>(tag)->value = scm_to_double(value);
+    return true;
+  case TAG_STRING:
+    if (!scm_is_string(value)) return false;
+    static_cast<StringTag *>(tag)->value = scm::from_scm<std::string>(value);
+    return true;
+  }
+  return false;
+}
+
+SCM_DEFINE_PUBLIC(c_nbt_path, "nbt-path", 0, 0, 1, (SCM segments), "Compile path steps (keys and list indices) for reuse with nbt-ref and nbt-set!") {
+  checkPath("nbt-path", segments);
+  return scm::to_scm(new NbtPath(compilePath(segments)));
+}
+
+SCM_DEFINE_PUBLIC(c_nbt_ref, "nbt-ref", 1, 0, 1, (scm::val<Tag *> tag, SCM segments), "Get value at path, #f if missing") {
+  NbtPath storage;
+  auto &path = resolvePath("nbt-ref", segments, storage);
+  return leafToScm(tag.scm, walkPath(tag, path, path.steps.size()));
+}
+
+SCM_DEFINE_PUBLIC(c_nbt_set, "nbt-set!", 2, 0, 1, (scm::val<Tag *> tag, SCM first, SCM rest),
+                  "Set value at path (last argument): numbers and strings update the existing leaf in place, "
+                  "tagged forms and tags replace or insert the node") {
+  // (nbt-set! tag step... value)
+  SCM all      = scm_cons(first, rest);
+  SCM value    = scm_car(scm_last_pair(all));
+  SCM segments = scm_list_head(all, scm_from_size_t(scm_ilength(all) - 1));
+  NbtPath storage;
+  auto &path = resolvePath("nbt-set!", segments, storage);
+  if (path.steps.empty()) scm_misc_error("nbt-set!", "Empty path", SCM_EOL);
+  auto parent = walkPath(tag, path, path.steps.size() - 1);
+  if (!parent) return SCM_BOOL_F;
+  auto &last = path.steps.back();
+
+  if (!scm_is_pair(value) && !SCM_STRUCTP(value)) {
+    auto leaf = child(parent, last);
+    return scm::to_scm(leaf && assignLeaf(leaf, value));
+  }
+  std::unique_ptr<Tag> node;
+  if (scm_is_pair(value)) {
+    NbtBuilder builder;
+    node = builder.build(value);
+    if (!node) scm_misc_error("nbt-set!", "~A: ~S", builder.error);
+  } else {
+    node = scm::from_scm<Tag *>(value)->copy();
+  }
+  if (last.isIndex) {
+    if (parent->getId() != TAG_LIST) return SCM_BOOL_F;
+    auto list  = static_cast<ListTag *>(parent);
+    auto index = last.index < 0 ? (long)list->value.size() + last.index : last.index;
+    if (!list->value.empty() && node->getId() != list->value.front()->getId()) return SCM_BOOL_F;
+    if (index == (long)list->value.size()) {
+      if (list->value.empty()) list->unk = node->getId();
+      list->value.emplace_back(std::move(node));
+    } else if (index >= 0 && index < (long)list->value.size()) {
+      std::swap(list->value[index], node);
+      nbtRootOf(tag.scm)->detach(std::move(node));
+    } else {
+      return SCM_BOOL_F;
+    }
+    return SCM_BOOL_T;
+  }
+  if (parent->getId() != TAG_COMPOUND) return SCM_BOOL_F;
+  auto &slot = static_cast<CompoundTag *>(parent)->value[last.key];
+  std::swap(slot, node);
+  if (node) nbtRootOf(tag.scm)->detach(std::move(node));
+  return SCM_BOOL_T;
+}
+
+// Patches are NBT themselves so they travel through the binary codec. One compound per changed
+// container: "remove" lists deleted keys, "set" holds new or replaced children, "nested" holds patches
+// for child containers. Children of lists are addressed by their decimal index; lists whose length
+// or element type changed are replaced as a whole. A patch is checked against the target before
+// anything is applied.
+static bool sameShape(Tag const &a, Tag const &b) {
+  if (a.getId() != b.getId()) return false;
+  if (a.getId() == TAG_COMPOUND) return true;
+  if (a.getId() != TAG_LIST) return false;
+  auto &lhs = (ListTag const &)a, &rhs = (ListTag const &)b;
+  return lhs.value.size() == rhs.value.size() && elementType(lhs) == elementType(rhs);
+}
+
+static std::unique_ptr<CompoundTag> diffTree(Tag const &a, Tag const &b);
+
+static void diffChild(Tag const &a, Tag const &b, std::string const &key, CompoundTag &set, CompoundTag &nested) {
+  if (sameShape(a, b)) {
+    if (auto sub = diffTree(a, b)) nested.value[key] = std::move(sub);
+    return;
+  }
+  if (a.getId() == b.getId() && a.equals(b)) return;
+  set.value[key] = b.copy();
+}
+
+static std::unique_ptr<CompoundTag> diffTree(Tag const &a, Tag const &b) {
+  auto set    = std::make_unique<CompoundTag>();
+  auto nested = std::make_unique<CompoundTag>();
+  auto remove = std::make_unique<ListTag>();
+  remove->unk = TAG_STRING;
+  if (a.getId() == TAG_COMPOUND) {
+    // Both maps are sorted, walk them in step
+    auto &lhs = ((CompoundTag const &)a).value;
+    auto &rhs = ((CompoundTag const &)b).value;
+    auto l = lhs.begin(), r = rhs.begin();
+    while (l != lhs.end() || r != rhs.end()) {
+      if (r == rhs.end() || (l != lhs.end() && l->first < r->first)) {
+        auto key   = std::make_unique<StringTag>();
+        key->value = l->first;
+        remove->value.emplace_back(std::move(key));
+        ++l;
+      } else if (l == lhs.end() || r->first < l->first) {
+        if (r->second) set->value[r->first] = r->second->copy();
+        ++r;
+      } else {
+        if (l->second && r->second)
+          diffChild(*l->second, *r->second, l->first, *set, *nested);
+        else if (r->second)
+          set->value[r->first] = r->second->copy();
+        ++l, ++r;
+      }
+    }
+  } else {
+    auto &lhs = ((ListTag const &)a).value;
+    auto &rhs = ((ListTag const &)b).value;
+    for (size_t i = 0; i < lhs.size(); i++) diffChild(*lhs[i], *rhs[i], std::to_string(i), *set, *nested);
+  }
+  if (set->value.empty() && nested->value.empty() && remove->value.empty()) return nullptr;
+  auto patch = std::make_unique<CompoundTag>();
+  if (!remove->value.empty()) patch->value["remove"] = std::move(remove);
+  if (!set->value.empty()) patch->value["set"] = std::move(set);
+  if (!nested->value.empty()) patch->value["nested"] = std::move(nested);
+  return patch;
+}
+
+std::unique_ptr<CompoundTag> diffNbt(CompoundTag const &from, CompoundTag const &to) { return diffTree(from, to); }
+
+static std::unique_ptr<Tag> *patchSlot(Tag &target, std::string const &key, bool create) {
+  if (target.getId() == TAG_COMPOUND) {
+    auto &map = static_cast<CompoundTag &>(target).value;
+    if (create) return &map[key];
+    auto it = map.find(key);
+    return it != map.end() ? &it->second : nullptr;
+  }
+  if (target.getId() != TAG_LIST) return nullptr;
+  auto &list = static_cast<ListTag &>(target).value;
+  char *end;
+  auto index = strtol(key.c_str(), &end, 10);
+  if (key.empty() || *end || index < 0 || (size_t)index >= list.size()) return nullptr;
+  return &list[index];
+}
+
+static Tag const *patchOp(CompoundTag const &patch, char const *name, unsigned char type) {
+  auto it = patch.value.find(name);
+  return it != patch.value.end() && it->second && it->second->getId() == type ? it->second.get() : nullptr;
+}
+
+// Dry run of applyPatch, so a mismatching patch leaves the target untouched
+static bool checkPatch(Tag &target, CompoundTag const &patch) {
+  auto remove = static_cast<ListTag const *>(patchOp(patch, "remove", TAG_LIST));
+  auto set    = static_cast<CompoundTag const *>(patchOp(patch, "set", TAG_COMPOUND));
+  auto nested = static_cast<CompoundTag const *>(patchOp(patch, "nested", TAG_COMPOUND));
+  auto removed = [&](std::string const &key) {
+    if (remove)
+      for (auto &entry : remove->value)
+        if (static_cast<StringTag const &>(*entry).value == key) return true;
+    return false;
+  };
+  if (remove) {
+    if (target.getId() != TAG_COMPOUND) return false;
+    for (auto &key : remove->value)
+      if (!key || key->getId() != TAG_STRING) return false;
+  }
+  if (set) {
+    for (auto &[key, value] : set->value) {
+      if (!value) return false;
+      if (target.getId() == TAG_COMPOUND) continue;
+      auto slot = patchSlot(target, key, false);
+      if (!slot || !*slot || value->getId() != (*slot)->getId()) return false;
+    }
+  }
+  if (nested) {
+    for (auto &[key, sub] : nested->value) {
+      if (!sub || sub->getId() != TAG_COMPOUND || removed(key)) return false;
+      Tag *child = nullptr;
+      if (set && set->value.count(key))
+        child = set->value.at(key).get();
+      else if (auto slot = patchSlot(target, key, false))
+        child = slot->get();
+      if (!child || !checkPatch(*child, static_cast<CompoundTag &>(*sub))) return false;
+    }
+  }
+  return true;
+}
+
+static void applyPatch(Tag &target, CompoundTag const &patch, NbtRoot *owner) {
+  if (auto remove = static_cast<ListTag const *>(patchOp(patch, "remove", TAG_LIST))) {
+    auto &map = static_cast<CompoundTag &>(target).value;
+    for (auto &key : remove->value) {
+      auto entry = map.find(static_cast<StringTag &>(*key).value);
+      if (entry == map.end()) continue;
+      auto old = std::move(entry->second);
+      map.erase(entry);
+      if (old && owner) owner->detach(std::move(old));
+    }
+  }
+  if (auto set = static_cast<CompoundTag const *>(patchOp(patch, "set", TAG_COMPOUND))) {
+    for (auto &[key, value] : set->value) {
+      auto slot = patchSlot(target, key, true);
+      auto old  = value->copy();
+      std::swap(*slot, old);
+      if (old && owner) owner->detach(std::move(old));
+    }
+  }
+  if (auto nested = static_cast<CompoundTag const *>(patchOp(patch, "nested", TAG_COMPOUND)))
+    for (auto &[key, sub] : nested->value) applyPatch(**patchSlot(target, key, false), static_cast<CompoundTag &>(*sub), owner);
+}
+
+bool patchNbt(Tag &target, CompoundTag const &patch, NbtRoot *owner) {
+  if (!checkPatch(target, patch)) return false;
+  applyPatch(target, patch, owner);
+  return true;
+}
+
+SCM_DEFINE_PUBLIC(c_nbt_diff, "nbt-diff", 2, 0, 0, (scm::val<CompoundTag *> from, scm::val<CompoundTag *> to),
+                  "Compute patch turning from into to, #f if they are equal") {
+  return scm::to_scm(diffNbt(*from.get(), *to.get()).release());
+}
+
+SCM_DEFINE_PUBLIC(c_nbt_patch, "nbt-patch!", 2, 0, 0, (scm::val<CompoundTag *> target, scm::val<CompoundTag *> patch),
+                  "Apply patch from nbt-diff in place, #f (leaving target untouched) if it does not match its shape") {
+  return scm::to_scm(patchNbt(*target.get(), *patch.get(), nbtRootOf(target.scm)));
+}
+
+SCM_DEFINE_PUBLIC(c_nbt_to_bytevector, "nbt->bytevector", 1, 0, 0, (scm::val<Tag *> tag), "Serialize NBT to little-endian binary, #f if a string is longer than 65535 bytes") {
+  std::string out;
+  out.reserve(256);
+  if (!writeNbt(*tag.get(), out)) return SCM_BOOL_F;
+  SCM bv = scm_c_make_bytevector(out.size());
+  memcpy(SCM_BYTEVECTOR_CONTENTS(bv), out.data(), out.size());
+  return bv;
+}
+
+SCM_DEFINE_PUBLIC(c_bytevector_to_nbt, "bytevector->nbt", 1, 0, 0, (SCM bv), "Deserialize little-endian binary NBT, #f if malformed") {
+  SCM_ASSERT_TYPE(scm_is_bytevector(bv), bv, 1, "bytevector->nbt", "bytevector");
+  auto tag = readNbt((char const *)SCM_BYTEVECTOR_CONTENTS(bv), SCM_BYTEVECTOR_LENGTH(bv));
+  if (!tag) return SCM_BOOL_F;
+  return scm::to_scm(tag.release());
+}
+
 PRELOAD_MODULE("minecraft nbt") {
 #ifndef DIAG
 #include "main.x"
@@ -1,10 +1,145 @@
 #include <api.h>
 #include <tags.h>
 
+#include <climits>
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+enum TagType : unsigned char {
+  TAG_END,
+  TAG_BYTE,
+  TAG_SHORT,
+  TAG_INT,
+  TAG_INT64,
+  TAG_FLOAT,
+  TAG_DOUBLE,
+  TAG_BYTEARRAY,
+  TAG_STRING,
+  TAG_LIST,
+  TAG_COMPOUND,
+  TAG_INTARRAY,
+};
+
+// Every handle into one tree shares its root record. The tree is freed by nbt-close or once the last
+// handle is collected. A node replaced through nbt-set! or nbt-patch! is freed at once unless a handle
+// or array view still points into it; then it is parked in detached until the last of those is gone.
+// Array views alias tag memory, so while any is alive nbt-close only invalidates the handles and the
+// last view to go frees the tree. Handles are released by the finalizer thread, hence the mutex.
+struct NbtRoot {
+  std::unique_ptr<Tag> tag;
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Tag>> detached;
+  std::unordered_map<Tag const *, size_t> live; // handles and views per node
+  std::atomic<size_t> refs{ 0 };                // handles and array views
+  std::atomic<size_t> views{ 0 };
+  std::atomic<bool> closed{ false }, freed{ false };
+
+  void freeTree() {
+    if (freed.exchange(true)) return;
+    std::lock_guard lock(mutex);
+    tag.reset();
+    detached.clear();
+  }
+
+  void close() {
+    closed = true;
+    if (views == 0) freeTree();
+  }
+
+  void acquire(Tag const *node) {
+    refs++;
+    std::lock_guard lock(mutex);
+    live[node]++;
+  }
+
+  void release(Tag const *node) {
+    {
+      std::lock_guard lock(mutex);
+      if (auto it = live.find(node); it != live.end() && --it->second == 0) live.erase(it);
+    }
+    if (--refs == 0) delete this;
+  }
+
+  void releaseView(Tag const *node) {
+    if (--views == 0 && closed) freeTree();
+    release(node);
+  }
+
+  // Takes a node just unlinked from the tree. Parked nodes are only swept here, on the server thread
+  // that also mutates them, so detached never holds more than what was pinned at the last detach.
+  void detach(std::unique_ptr<Tag> node) {
+    std::lock_guard lock(mutex);
+    sweep();
+    if (pinned(*node)) detached.emplace_back(std::move(node));
+  }
+
+private:
+  bool pinned(Tag const &node) const {
+    if (live.count(&node)) return true;
+    if (node.getId() == TAG_COMPOUND)
+      for (auto &[key, child] : static_cast<CompoundTag const &>(node).value)
+        if (child && pinned(*child)) return true;
+    if (node.getId() == TAG_LIST)
+      for (auto &child : static_cast<ListTag const &>(node).value)
+        if (child && pinned(*child)) return true;
+    return false;
+  }
+
+  void sweep() {
+    for (size_t i = 0; i < detached.size();)
+      if (pinned(*detached[i])) {
+        i++;
+      } else {
+        detached[i] = std::move(detached.back());
+        detached.pop_back();
+      }
+  }
+};
+
+struct NbtHandle {
+  Tag *tag;
+  NbtRoot *root;
+};
+
+inline void releaseNbtHandle(SCM scm) {
+  auto handle = (NbtHandle *)scm_foreign_object_ref(scm, 0);
+  if (!handle) return;
+  handle->root->release(handle->tag);
+  delete handle;
+}
+
+inline NbtRoot *nbtRootOf(SCM scm) { return ((NbtHandle *)scm_foreign_object_ref(scm, 0))->root; }
+
+namespace scm {
+// to_scm takes ownership of a fresh tree, children are wrapped through nbtChild
+template <typename T> struct nbt_convertible : foreign_type_convertible<T *> {
+  using ft = foreign_type_convertible<T *>;
+  static SCM wrap(T *tag, NbtRoot *root) {
+    root->acquire(tag);
+    return scm_make_foreign_object_1(ft::type(), new NbtHandle{ tag, root });
+  }
+  static SCM to_scm(T *tag) {
+    if (!tag) return SCM_BOOL_F;
+    auto root = new NbtRoot;
+    root->tag.reset(tag);
+    return wrap(tag, root);
+  }
+  static T *from_scm(SCM scm) {
+    scm_assert_foreign_object_type(ft::type(), scm);
+    auto handle = (NbtHandle *)scm_foreign_object_ref(scm, 0);
+    if (handle->root->closed) scm_misc_error("nbt", "NBT handle used after nbt-close: ~S", scm_list_1(scm));
+    return (T *)handle->tag;
+  }
+};
+} // namespace scm
+
 #define GTYPE(t, name)                                                                                                                               \
-  MAKE_FOREIGN_TYPE(t *, name)                                                                                                                       \
+  MAKE_FOREIGN_TYPE(t *, name, releaseNbtHandle)                                                                                                     \
   namespace scm {                                                                                                                                    \
-  template <> struct convertible<t *> : foreign_object_is_convertible<t *> {};                                                                       \
+  template <> struct convertible<t *> : nbt_convertible<t> {};                                                                                       \
   }
 
 GTYPE(CompoundTag, "nbt-compound");
@@ -21,11 +156,33 @@ GTYPE(StringTag, "nbt-string");
 
 #undef GTYPE
 
-namespace scm {
-template <> struct convertible<Tag *> {
-  static SCM to_scm(Tag *tag) {
+template <typename T> constexpr TagType tagTypeOf = TAG_END;
+template <> constexpr TagType tagTypeOf<ByteTag>      = TAG_BYTE;
+template <> constexpr TagType tagTypeOf<ShortTag>     = TAG_SHORT;
+template <> constexpr TagType tagTypeOf<IntTag>       = TAG_INT;
+template <> constexpr TagType tagTypeOf<Int64Tag>     = TAG_INT64;
+template <> constexpr TagType tagTypeOf<FloatTag>     = TAG_FLOAT;
+template <> constexpr TagType tagTypeOf<DoubleTag>    = TAG_DOUBLE;
+template <> constexpr TagType tagTypeOf<ByteArrayTag> = TAG_BYTEARRAY;
+template <> constexpr TagType tagTypeOf<StringTag>    = TAG_STRING;
+template <> constexpr TagType tagTypeOf<ListTag>      = TAG_LIST;
+template <> constexpr TagType tagTypeOf<CompoundTag>  = TAG_COMPOUND;
+template <> constexpr TagType tagTypeOf<IntArrayTag>  = TAG_INTARRAY;
+
+inline bool isNbtHandle(SCM scm) {
+#define TEST(T) SCM_IS_A_P(scm, scm::foreign_type_convertible<T *>::type()) ||
+  return TEST(CompoundTag) TEST(StringTag) TEST(ListTag) TEST(DoubleTag) TEST(ShortTag) TEST(Int64Tag) TEST(FloatTag) TEST(IntTag) TEST(ByteTag)
+      TEST(IntArrayTag) TEST(ByteArrayTag) false;
+#undef TEST
+}
+
+// Handle for a node inside the tree owned by parent's root
+inline SCM nbtChild(SCM parent, Tag *tag) {
+  if (!tag) return SCM_BOOL_F;
+  auto root = nbtRootOf(parent);
+  switch (tag->getId()) {
 #define CASE(T)                                                                                                                                      \
-  if (auto target = dynamic_cast<T *>(tag); target) { return scm::to_scm(target); }
+  case tagTypeOf<T>: return scm::convertible<T *>::wrap(static_cast<T *>(tag), root);
     CASE(CompoundTag);
     CASE(StringTag);
     CASE(ListTag);
@@ -37,6 +194,30 @@ template <> struct convertible<Tag *> {
     CASE(ByteTag);
     CASE(IntArrayTag);
     CASE(ByteArrayTag);
+#undef CASE
+  }
+  return SCM_BOOL_F;
+}
+
+namespace scm {
+template <> struct convertible<Tag *> {
+  static SCM to_scm(Tag *tag) {
+    if (!tag) return SCM_BOOL_F;
+    switch (tag->getId()) {
+#define CASE(T)                                                                                                                                      \
+  case tagTypeOf<T>: return scm::to_scm(static_cast<T *>(tag));
+      CASE(CompoundTag);
+      CASE(StringTag);
+      CASE(ListTag);
+      CASE(DoubleTag);
+      CASE(ShortTag);
+      CASE(Int64Tag);
+      CASE(FloatTag);
+      CASE(IntTag);
+      CASE(ByteTag);
+      CASE(IntArrayTag);
+      CASE(ByteArrayTag);
+    }
 #undef CASE
     return SCM_BOOL_F;
   }
@@ -59,4 +240,18 @@ template <> struct convertible<Tag *> {
     return nullptr;
   }
 };
-} // namespace scm
\ No newline at end of file
+} // namespace scm
+// Little-endian Bedrock NBT, as a named root tag; false if a string does not fit its u16 length
+bool writeNbt(Tag const &tag, std::string &out, std::string const &name = "");
+std::unique_ptr<Tag> readNbt(char const *data, size_t size, std::string *name = nullptr);
+
+// Text form: the dump form used by toString, or SNBT; nesting beyond maxDepth and output past maxSize become "..."
+void formatNbt(Tag const &tag, std::string &out, bool snbt = false, int maxDepth = INT_MAX, size_t maxSize = SIZE_MAX);
+
+// SNBT as written by formatNbt, nullptr with a message (and offset) on error
+std::unique_ptr<Tag> parseSnbt(char const *text, size_t size, std::string *error = nullptr);
+
+// Patch (itself NBT) turning from into to, nullptr if equal; replaced nodes of target are handed to
+// owner's detach, or freed at once without an owner
+std::unique_ptr<CompoundTag> diffNbt(CompoundTag const &from, CompoundTag const &to);
+bool patchNbt(Tag &target, CompoundTag const &patch, NbtRoot *owner = nullptr);
@@ -0,0 +1,180 @@
+// Deps: out/script_player_data.so: out/script_base.so out/script_tick.so out/script_storage.so
+#include "../base/main.h"
+#include "../storage/main.h"
+#include "../tick/main.h"
+
+#include <api.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Fields of one online player. Loading starts on join and runs on the storage thread; values set
+// before it completes win over the loaded ones.
+struct PlayerBag {
+  uint64_t generation;
+  bool ready = false;
+  std::unordered_map<std::string, StorageDatum> fields;
+  std::unordered_set<std::string> dirty;
+};
+
+struct LoadedBag {
+  mce::UUID uuid;
+  uint64_t generation;
+  StorageRows rows;
+};
+
+static char const *selectSql = "SELECT field, value FROM player_data WHERE uuid = ?";
+static char const *putSql    = "INSERT OR REPLACE INTO player_data(uuid, field, value) VALUES(?, ?, ?)";
+static char const *eraseSql  = "DELETE FROM player_data WHERE uuid = ? AND field = ?";
+
+static std::unordered_map<mce::UUID, PlayerBag> bags;
+static uint64_t generations   = 0;
+static uint64_t flushInterval = 1200; // ticks
+
+// Filled by the storage thread, drained after each tick
+static std::mutex loadedMutex;
+static std::vector<LoadedBag> loaded;
+
+// Declared after everything its thread touches, so it is torn down first at exit
+static std::unique_ptr<Storage> store;
+
+MAKE_HOOK(player_data_loaded, "player-data-loaded", ServerPlayer *);
+
+static StorageBlob uuidKey(mce::UUID const &uuid) { return { std::string((char const *)&uuid, sizeof uuid) }; }
+
+static void writeDirty(mce::UUID const &uuid, PlayerBag &bag) {
+  for (auto &field : bag.dirty) {
+    auto &value = bag.fields[field];
+    if (value.index() == 0)
+      store->execute(eraseSql, { uuidKey(uuid), field });
+    else
+      store->execute(putSql, { uuidKey(uuid), field, value });
+  }
+  bag.dirty.clear();
+}
+
+static void writeAllDirty() {
+  for (auto &[uuid, bag] : bags) writeDirty(uuid, bag);
+}
+
+static void startLoad(ServerPlayer &player) {
+  auto uuid  = player.getUUID();
+  auto &bag  = bags[uuid];
+  bag        = {};
+  auto generation = bag.generation = ++generations;
+  store->queryAsync(selectSql, { uuidKey(uuid) }, [=](StorageRows rows) {
+    std::lock_guard lock(loadedMutex);
+    loaded.push_back({ uuid, generation, std::move(rows) });
+  });
+}
+
+static void finishLoads() {
+  std::vector<LoadedBag> done;
+  {
+    std::lock_guard lock(loadedMutex);
+    done.swap(loaded);
+  }
+  for (auto &result : done) {
+    auto it = bags.find(result.uuid);
+    if (it == bags.end() || it->second.generation != result.generation) continue; // left (and maybe rejoined) meanwhile
+    auto &bag = it->second;
+    for (auto &row : result.rows)
+      if (row.size() == 2 && row[0].index() == 3) bag.fields.try_emplace(std::get<std::string>(row[0]), std::move(row[1]));
+    bag.ready = true;
+    if (auto player = findPlayerByUUID(result.uuid)) player_data_loaded(player);
+  }
+}
+
+static PlayerBag &bagOf(ServerPlayer *player) {
+  if (!store) scm_misc_error("player-data", "Player data store is not open", SCM_EOL);
+  auto it = bags.find(player->getUUID());
+  if (it == bags.end()) scm_misc_error("player-data", "Player is not online: ~S", scm::list(player));
+  return it->second;
+}
+
+SCM_DEFINE_PUBLIC(c_player_data_open, "player-data-open", 1, 0, 0, (scm::val<std::string> path),
+                  "Open per-player data store, loaded on join and written back on leave") {
+  auto next = std::unique_ptr<Storage>(Storage::open(path));
+  if (!next) return SCM_BOOL_F;
+  next->execute("CREATE TABLE IF NOT EXISTS player_data(uuid BLOB, field TEXT, value, PRIMARY KEY(uuid, field)) WITHOUT ROWID", {});
+  if (store) {
+    writeAllDirty();
+    bags.clear();
+  }
+  store = std::move(next);
+  for (auto &entry : *getPlayerList()) startLoad(*entry.player);
+  return SCM_BOOL_T;
+}
+
+SCM_DEFINE_PUBLIC(c_player_data_ready, "player-data-ready?", 1, 0, 0, (scm::val<ServerPlayer *> player), "Test if player's data has been loaded") {
+  if (!store) return SCM_BOOL_F;
+  auto it = bags.find(player->getUUID());
+  return scm::to_scm(it != bags.end() && it->second.ready);
+}
+
+SCM_DEFINE_PUBLIC(c_player_data_ref, "player-data-ref", 2, 1, 0, (scm::val<ServerPlayer *> player, scm::val<std::string> field, SCM fallback),
+                  "Get field of online player's data, fallback or #f if missing") {
+  auto &fields = bagOf(player).fields;
+  auto it      = fields.find(field);
+  if (it == fields.end() || it->second.index() == 0) return SCM_UNBNDP(fallback) ? SCM_BOOL_F : fallback;
+  return storageDatumToScm(it->second);
+}
+
+SCM_DEFINE_PUBLIC(c_player_data_set, "player-data-set!", 3, 0, 0, (scm::val<ServerPlayer *> player, scm::val<std::string> field, SCM value),
+                  "Set field of online player's data to number, string or bytevector (#f deletes)") {
+  auto &bag         = bagOf(player);
+  bag.fields[field] = storageDatumFromScm(value);
+  bag.dirty.insert(field);
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_player_data_fields, "player-data-fields", 1, 0, 0, (scm::val<ServerPlayer *> player), "List field names of player's data") {
+  SCM ret = SCM_EOL;
+  for (auto &[field, value] : bagOf(player).fields)
+    if (value.index() != 0) ret = scm_cons(scm::to_scm(field), ret);
+  return ret;
+}
+
+SCM_DEFINE_PUBLIC(c_player_data_flush, "player-data-flush", 0, 0, 0, (), "Write back all modified player data and wait for it") {
+  if (!store) return SCM_UNSPECIFIED;
+  writeAllDirty();
+  store->flush();
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_player_data_set_flush_interval, "player-data-set-flush-interval!", 1, 0, 0, (scm::val<uint64_t> ticks),
+                  "Set how often modified player data is written back (ticks)") {
+  flushInterval = ticks;
+  return SCM_UNSPECIFIED;
+}
+
+// Whatever is still dirty at exit goes out with the storage thread's last batch
+static struct FinalFlush {
+  ~FinalFlush() {
+    if (store) writeAllDirty();
+  }
+} finalFlush;
+
+PRELOAD_MODULE("minecraft player-data") {
+#ifndef DIAG
+#include "main.x"
+#endif
+  // Join/leave come from libsupport's onReady_ClientGeneration and _onPlayerLeft hooks
+  onPlayerJoined <<= [](ServerPlayer &player) {
+    if (store) startLoad(player);
+  };
+  onPlayerLeft <<= [](ServerPlayer &player) {
+    auto it = bags.find(player.getUUID());
+    if (it == bags.end()) return;
+    if (store) writeDirty(it->first, it->second);
+    bags.erase(it);
+  };
+  onPostTick([] {
+    if (!store) return;
+    finishLoads();
+    if (flushInterval && getCurrentTick() % flushInterval == 0) writeAllDirty();
+  });
+}
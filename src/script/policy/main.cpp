@@ -4,6 +4,8 @@
 
 #include <StaticHook.h>
 
+#include "main.h"
+
 MAKE_FLUID(bool, policy_result, "policy-result");
 MAKE_FLUID(ServerPlayer *, policy_self, "policy-self");
 
@@ -17,6 +19,31 @@ struct GameMode {
   }
 };
 
+static std::vector<std::function<void(ServerPlayer *, BlockPos const &, Block *, Block *)>> blockChangeHandlers;
+
+void onPlayerBlockChange(std::function<void(ServerPlayer *, BlockPos const &, Block *, Block *)> callback) {
+  blockChangeHandlers.push_back(callback);
+}
+
+// Remembers the block at pos before an action and reports it if the action replaced it
+struct BlockWatch {
+  ServerPlayer *player;
+  BlockPos pos;
+  Block *before;
+
+  BlockWatch(ServerPlayer *player, BlockPos const &pos)
+      : player(player)
+      , pos(pos)
+      , before(blockChangeHandlers.empty() ? nullptr : player->getRegion().getBlock(pos)) {}
+
+  void commit() {
+    if (!before) return;
+    auto after = player->getRegion().getBlock(pos);
+    if (after == before) return;
+    for (auto &handler : blockChangeHandlers) handler(player, pos, before, after);
+  }
+};
+
 MAKE_HOOK(player_attack, "policy-player-attack", Actor *);
 TInstanceHook(bool, _ZN8GameMode6attackER5Actor, GameMode, Actor *target) {
   if (queryPolicy(player_attack, target)) { return original(this, target); }
@@ -25,7 +52,12 @@ TInstanceHook(bool, _ZN8GameMode6attackER5Actor, GameMode, Actor *target) {
 
 MAKE_HOOK(player_destroy, "policy-player-destroy", BlockPos);
 TInstanceHook(bool, _ZN8GameMode12destroyBlockERK8BlockPosa, GameMode, BlockPos const &pos, signed char flag) {
-  if (queryPolicy(player_destroy, pos)) { return original(this, pos, flag); }
+  if (queryPolicy(player_destroy, pos)) {
+    BlockWatch watch{ player, pos };
+    auto ret = original(this, pos, flag);
+    if (ret) watch.commit();
+    return ret;
+  }
   return false;
 }
 
@@ -44,7 +76,17 @@ TInstanceHook(bool, _ZN8GameMode7useItemER12ItemInstance, GameMode, ItemInstance
 MAKE_HOOK(player_use_on, "policy-player-use-on", ItemInstance *, BlockPos, Vec3);
 TInstanceHook(bool, _ZN8GameMode9useItemOnER12ItemInstanceRK8BlockPosaRK4Vec3, GameMode, ItemInstance *instance, BlockPos &pos,
               char flag, Vec3 &vec, void *callback) {
-  if (queryPolicy(player_use_on, instance, pos, vec)) { return original(this, instance, pos, flag, vec, callback); }
+  if (queryPolicy(player_use_on, instance, pos, vec)) {
+    static int const faces[6][3] = { { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 1, 0, 0 } };
+    auto face = faces[(unsigned char)flag % 6];
+    BlockWatch target{ player, pos }, placed{ player, { pos.x + face[0], pos.y + face[1], pos.z + face[2] } };
+    auto ret = original(this, instance, pos, flag, vec, callback);
+    if (ret) {
+      target.commit();
+      placed.commit();
+    }
+    return ret;
+  }
   return false;
 }
 
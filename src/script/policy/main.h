@@ -0,0 +1,4 @@
+#include <api.h>
+
+// Called after a player action changed a block, with the block before and after
+void onPlayerBlockChange(std::function<void(ServerPlayer *, BlockPos const &, Block *, Block *)> callback);
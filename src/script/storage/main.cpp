@@ -0,0 +1,376 @@
+#include <api.h>
+
+#include <sqlite3.h>
+
+#include "main.h"
+
+StorageDatum storageDatumFromScm(SCM value) {
+  if (scm_is_signed_integer(value, INT64_MIN, INT64_MAX)) return scm_to_int64(value);
+  if (scm_is_real(value)) return scm_to_double(value);
+  if (scm_is_string(value)) return scm::from_scm<std::string>(value);
+  if (scm_is_bytevector(value)) return StorageBlob{ std::string((char const *)SCM_BYTEVECTOR_CONTENTS(value), SCM_BYTEVECTOR_LENGTH(value)) };
+  if (scm_is_false(value) || scm_is_eq(value, SCM_ELISP_NIL)) return std::monostate{};
+  scm_wrong_type_arg("storage", 0, value);
+}
+
+SCM storageDatumToScm(StorageDatum const &datum) {
+  switch (datum.index()) {
+  case 1: return scm::to_scm(std::get<int64_t>(datum));
+  case 2: return scm::to_scm(std::get<double>(datum));
+  case 3: return scm::to_scm(std::get<std::string>(datum));
+  case 4: {
+    auto &blob = std::get<StorageBlob>(datum).data;
+    SCM bv     = scm_c_make_bytevector(blob.size());
+    memcpy(SCM_BYTEVECTOR_CONTENTS(bv), blob.data(), blob.size());
+    return bv;
+  }
+  default: return SCM_BOOL_F;
+  }
+}
+
+static void bindDatum(sqlite3_stmt *stmt, int index, StorageDatum const &datum) {
+  switch (datum.index()) {
+  case 1: sqlite3_bind_int64(stmt, index, std::get<int64_t>(datum)); break;
+  case 2: sqlite3_bind_double(stmt, index, std::get<double>(datum)); break;
+  case 3: {
+    auto &text = std::get<std::string>(datum);
+    sqlite3_bind_text(stmt, index, text.data(), text.size(), SQLITE_STATIC);
+    break;
+  }
+  case 4: {
+    auto &blob = std::get<StorageBlob>(datum).data;
+    sqlite3_bind_blob(stmt, index, blob.data(), blob.size(), SQLITE_STATIC);
+    break;
+  }
+  default: sqlite3_bind_null(stmt, index);
+  }
+}
+
+static StorageDatum columnDatum(sqlite3_stmt *stmt, int column) {
+  switch (sqlite3_column_type(stmt, column)) {
+  case SQLITE_INTEGER: return (int64_t)sqlite3_column_int64(stmt, column);
+  case SQLITE_FLOAT: return sqlite3_column_double(stmt, column);
+  case SQLITE_TEXT: return std::string((char const *)sqlite3_column_text(stmt, column), sqlite3_column_bytes(stmt, column));
+  case SQLITE_BLOB: {
+    auto data = (char const *)sqlite3_column_blob(stmt, column);
+    return StorageBlob{ std::string(data, data ? sqlite3_column_bytes(stmt, column) : 0) };
+  }
+  default: return std::monostate{};
+  }
+}
+
+sqlite3_stmt *StatementCache::get(std::string const &sql) {
+  auto [it, inserted] = statements.try_emplace(sql, nullptr);
+  if (!inserted) {
+    sqlite3_reset(it->second);
+    sqlite3_clear_bindings(it->second);
+    return it->second;
+  }
+  if (sqlite3_prepare_v3(db, sql.data(), sql.size(), SQLITE_PREPARE_PERSISTENT, &it->second, nullptr) != SQLITE_OK) {
+    Log::error("storage", "Cannot prepare %s: %s", sql.c_str(), sqlite3_errmsg(db));
+    statements.erase(it);
+    return nullptr;
+  }
+  return it->second;
+}
+
+void StatementCache::clear() {
+  for (auto &[sql, stmt] : statements) sqlite3_finalize(stmt);
+  statements.clear();
+  if (db) sqlite3_close(db);
+  db = nullptr;
+}
+
+static char const *selectSql = "SELECT value FROM kv WHERE key = ?";
+static char const *putSql    = "INSERT OR REPLACE INTO kv(key, value) VALUES(?, ?)";
+static char const *eraseSql  = "DELETE FROM kv WHERE key = ?";
+
+Storage *Storage::open(std::string const &path, size_t capacity) {
+  auto storage      = std::make_unique<Storage>();
+  storage->capacity = capacity;
+  // The busy handler has to be in place before the first statement, another connection may hold the file
+  if (sqlite3_open_v2(path.c_str(), &storage->writer.db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK ||
+      sqlite3_busy_timeout(storage->writer.db, 5000) != SQLITE_OK ||
+      sqlite3_exec(storage->writer.db,
+                   "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;"
+                   "CREATE TABLE IF NOT EXISTS kv(key TEXT PRIMARY KEY, value) WITHOUT ROWID;",
+                   nullptr, nullptr, nullptr) != SQLITE_OK) {
+    Log::error("storage", "Cannot open %s: %s", path.c_str(), sqlite3_errmsg(storage->writer.db));
+    return nullptr;
+  }
+  if (sqlite3_open_v2(path.c_str(), &storage->reader.db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+    Log::error("storage", "Cannot open %s: %s", path.c_str(), sqlite3_errmsg(storage->reader.db));
+    return nullptr;
+  }
+  sqlite3_busy_timeout(storage->reader.db, 5000);
+  storage->thread = std::thread([ptr = storage.get()] { ptr->run(); });
+  return storage.release();
+}
+
+Storage::~Storage() { close(); }
+
+void Storage::close() {
+  if (thread.joinable()) {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+  }
+  writer.clear();
+  std::lock_guard lock(cacheMutex);
+  reader.clear();
+  lru.clear();
+  index.clear();
+}
+
+void Storage::remember(std::string const &key, StorageDatum value, uint64_t seq) {
+  if (auto it = index.find(key); it != index.end()) {
+    it->second->value = std::move(value);
+    if (seq) it->second->seq = seq;
+    lru.splice(lru.begin(), lru, it->second);
+    return;
+  }
+  lru.push_front({ key, std::move(value), seq });
+  index.emplace(key, lru.begin());
+  if (lru.size() <= capacity) return;
+  // Evict least recently used clean entries; dirty ones stay until their write is committed
+  auto done = committed.load();
+  for (auto it = std::prev(lru.end()); lru.size() > capacity && it != lru.begin();) {
+    auto victim = it--;
+    if (victim->seq > done) continue;
+    index.erase(victim->key);
+    lru.erase(victim);
+  }
+}
+
+StorageDatum Storage::get(std::string const &key) {
+  std::lock_guard lock(cacheMutex);
+  if (auto it = index.find(key); it != index.end()) {
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->value;
+  }
+  StorageDatum value;
+  if (auto stmt = reader.get(selectSql)) {
+    sqlite3_bind_text(stmt, 1, key.data(), key.size(), SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) value = columnDatum(stmt, 0);
+    sqlite3_reset(stmt);
+  }
+  remember(key, value, 0);
+  return value;
+}
+
+uint64_t Storage::enqueue(Op op) {
+  bool full;
+  uint64_t seq;
+  {
+    std::lock_guard lock(mutex);
+    seq  = op.seq = ++queued;
+    full = op.kind == Op::QUERY; // somebody is waiting for the answer
+    if (full) flushing = true;
+    queue.push_back(std::move(op));
+    full = full || queue.size() >= batchSize;
+  }
+  if (full) wake.notify_one();
+  return seq;
+}
+
+void Storage::put(std::string const &key, StorageDatum value) {
+  bool erase = value.index() == 0;
+  std::lock_guard lock(cacheMutex); // held across enqueue so the LRU sees writes in queue order
+  auto seq = enqueue({ erase ? Op::ERASE : Op::PUT, key, erase ? std::vector<StorageDatum>{} : std::vector<StorageDatum>{ value }, 0 });
+  remember(key, std::move(value), seq);
+}
+
+void Storage::execute(std::string const &sql, std::vector<StorageDatum> params) { enqueue({ Op::EXEC, sql, std::move(params), 0 }); }
+
+void Storage::queryAsync(std::string const &sql, std::vector<StorageDatum> params, std::function<void(StorageRows)> callback) {
+  enqueue({ Op::QUERY, sql, std::move(params), 0, std::move(callback) });
+}
+
+bool Storage::query(std::string const &sql, std::vector<StorageDatum> const &params, StorageRows &rows, std::string &error) {
+  std::lock_guard lock(cacheMutex);
+  auto stmt = reader.get(sql);
+  if (!stmt) {
+    error = sqlite3_errmsg(reader.db);
+    return false;
+  }
+  for (size_t i = 0; i < params.size(); i++) bindDatum(stmt, i + 1, params[i]);
+  int columns = sqlite3_column_count(stmt);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    auto &row = rows.emplace_back();
+    for (int i = 0; i < columns; i++) row.push_back(columnDatum(stmt, i));
+  }
+  sqlite3_reset(stmt);
+  return true;
+}
+
+void Storage::flush() {
+  std::unique_lock lock(mutex);
+  auto target = queued;
+  flushing    = true;
+  wake.notify_one();
+  done.wait(lock, [&] { return committed >= target; });
+}
+
+void Storage::run() {
+  static constexpr int maxRetries = 3; // once stopping, so a dead disk cannot hang shutdown
+  std::unique_lock lock(mutex);
+  int failures = 0;
+  for (;;) {
+    wake.wait_for(lock, interval, [&] { return stopping || flushing || queue.size() >= batchSize; });
+    flushing = false;
+    if (queue.empty()) {
+      if (stopping) return;
+      continue;
+    }
+    auto batch = std::move(queue);
+    queue.clear();
+    lock.unlock();
+    bool ok = commit(batch);
+    lock.lock();
+    if (!ok && !(stopping && ++failures > maxRetries)) {
+      // Dirty entries stay pinned until the batch is really committed; it goes back in front of
+      // whatever was queued meanwhile and is retried after a pause
+      batch.insert(batch.end(), std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.end()));
+      queue = std::move(batch);
+      wake.wait_for(lock, interval, [&] { return stopping; });
+      continue;
+    }
+    if (!ok) Log::error("storage", "Giving up on %zu queued operations at shutdown", batch.size());
+    failures  = 0;
+    committed = batch.back().seq;
+    done.notify_all();
+  }
+}
+
+// Errors that say nothing about the statement itself abort the whole transaction so it can be retried
+static bool transient(int rc) {
+  rc &= 0xFF;
+  return rc == SQLITE_BUSY || rc == SQLITE_LOCKED || rc == SQLITE_IOERR || rc == SQLITE_FULL;
+}
+
+// Query answers are held back until COMMIT succeeds, a retried batch must not answer twice
+bool Storage::commit(std::vector<Op> &batch) {
+  if (sqlite3_exec(writer.db, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK) {
+    Log::error("storage", "Cannot begin transaction: %s", sqlite3_errmsg(writer.db));
+    return false;
+  }
+  std::vector<std::pair<Op *, StorageRows>> answers;
+  for (auto &op : batch) {
+    auto stmt = writer.get(op.kind == Op::PUT ? putSql : op.kind == Op::ERASE ? eraseSql : op.text);
+    if (!stmt) {
+      if (op.callback) answers.emplace_back(&op, StorageRows{});
+      continue;
+    }
+    int index = 1;
+    if (op.kind == Op::PUT || op.kind == Op::ERASE) sqlite3_bind_text(stmt, index++, op.text.data(), op.text.size(), SQLITE_STATIC);
+    for (auto &param : op.params) bindDatum(stmt, index++, param);
+    int rc;
+    StorageRows rows;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      if (op.kind != Op::QUERY) continue;
+      auto &row = rows.emplace_back();
+      for (int i = 0, columns = sqlite3_column_count(stmt); i < columns; i++) row.push_back(columnDatum(stmt, i));
+    }
+    if (rc != SQLITE_DONE) Log::error("storage", "Statement failed: %s", sqlite3_errmsg(writer.db));
+    sqlite3_reset(stmt);
+    if (transient(rc)) {
+      sqlite3_exec(writer.db, "ROLLBACK", nullptr, nullptr, nullptr);
+      return false;
+    }
+    if (op.callback) answers.emplace_back(&op, std::move(rows));
+  }
+  if (sqlite3_exec(writer.db, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK) {
+    Log::error("storage", "Commit failed: %s", sqlite3_errmsg(writer.db));
+    sqlite3_exec(writer.db, "ROLLBACK", nullptr, nullptr, nullptr);
+    return false;
+  }
+  for (auto &[op, rows] : answers) op->callback(std::move(rows));
+  return true;
+}
+
+MAKE_FOREIGN_TYPE(Storage *, "storage", [](SCM s) { delete (Storage *)scm_foreign_object_ref(s, 0); });
+
+static std::vector<StorageDatum> paramsFromScm(SCM args) {
+  std::vector<StorageDatum> params;
+  for (; scm_is_pair(args); args = SCM_CDR(args)) params.push_back(storageDatumFromScm(SCM_CAR(args)));
+  return params;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_open, "storage-open", 1, 1, 0, (scm::val<std::string> path, scm::val<size_t> capacity),
+                  "Open key-value storage file, optionally with LRU capacity in entries") {
+  auto storage = Storage::open(path, capacity[4096]);
+  return storage ? scm::to_scm(storage) : SCM_BOOL_F;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_close, "storage-close", 1, 0, 0, (SCM storage), "Commit pending writes and close storage (idempotent)") {
+  delete scm::foreign_object_is_convertible<Storage *>::from_scm(storage);
+  scm_foreign_object_set_x(storage, 0, nullptr);
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_ref, "storage-ref", 2, 1, 0, (scm::val<Storage *> storage, scm::val<std::string> key, SCM fallback),
+                  "Get value of key (number, string or bytevector), fallback or #f if missing") {
+  auto value = storage->get(key);
+  if (value.index() == 0) return SCM_UNBNDP(fallback) ? SCM_BOOL_F : fallback;
+  return storageDatumToScm(value);
+}
+
+SCM_DEFINE_PUBLIC(c_storage_set, "storage-set!", 3, 0, 0, (scm::val<Storage *> storage, scm::val<std::string> key, SCM value),
+                  "Set key to number, string or bytevector (#f deletes), written in the background") {
+  storage->put(key, storageDatumFromScm(value));
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_delete, "storage-delete!", 2, 0, 0, (scm::val<Storage *> storage, scm::val<std::string> key), "Delete key") {
+  storage->erase(key);
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_execute, "storage-execute!", 2, 0, 1, (scm::val<Storage *> storage, scm::val<std::string> sql, SCM args),
+                  "Queue SQL statement with arguments for the background writer") {
+  storage->execute(sql, paramsFromScm(args));
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_query, "storage-query", 2, 0, 1, (scm::val<Storage *> storage, scm::val<std::string> sql, SCM args),
+                  "Run cached SQL query with arguments, list of row vectors (committed data only)") {
+  auto params = paramsFromScm(args);
+  StorageRows rows;
+  std::string error;
+  // Raised only after query() dropped its lock
+  if (!storage->query(sql, params, rows, error)) scm_misc_error("storage-query", "Cannot prepare ~A: ~A", scm::list(sql.scm, error));
+  SCM ret = SCM_EOL;
+  for (auto it = rows.rbegin(); it != rows.rend(); ++it) {
+    SCM row = scm_c_make_vector(it->size(), SCM_BOOL_F);
+    for (size_t i = 0; i < it->size(); i++) scm_c_vector_set_x(row, i, storageDatumToScm((*it)[i]));
+    ret = scm_cons(row, ret);
+  }
+  return ret;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_flush, "storage-flush", 1, 0, 0, (scm::val<Storage *> storage), "Wait until all queued writes are committed") {
+  storage->flush();
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(c_storage_set_write_behind, "storage-set-write-behind!", 3, 0, 0,
+                  (scm::val<Storage *> storage, scm::val<int> interval, scm::val<int> batch),
+                  "Set background commit interval (ms) and queue length that triggers an early commit") {
+  // Convert first, a type error raised while holding the mutex would leave it locked
+  Storage *target = storage;
+  int ms = interval, size = batch;
+  if (ms <= 0 || size <= 0) scm_misc_error("storage-set-write-behind!", "Interval and batch must be positive: ~A ~A", scm::list(ms, size));
+  std::lock_guard lock(target->mutex);
+  target->interval  = std::chrono::milliseconds(ms);
+  target->batchSize = size;
+  return SCM_UNSPECIFIED;
+}
+
+PRELOAD_MODULE("minecraft storage") {
+#ifndef DIAG
+#include "main.x"
+#endif
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <api.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+struct StorageBlob {
+  std::string data;
+};
+
+// Any value sqlite can hold; monostate is SQL NULL / missing key
+using StorageDatum = std::variant<std::monostate, int64_t, double, std::string, StorageBlob>;
+
+using StorageRows = std::vector<std::vector<StorageDatum>>;
+
+StorageDatum storageDatumFromScm(SCM value);
+SCM storageDatumToScm(StorageDatum const &datum);
+
+// Prepared statements of one connection, keyed by their SQL text
+struct StatementCache {
+  sqlite3 *db = nullptr;
+  std::unordered_map<std::string, sqlite3_stmt *> statements;
+
+  sqlite3_stmt *get(std::string const &sql); // reset and unbound, nullptr on syntax error
+  void clear();
+};
+
+// Key-value store backed by sqlite. Reads are answered from an LRU in front of a reader connection;
+// writes update the LRU at once and are committed by a background thread in batched transactions, so
+// the server thread never waits for the disk. Entries with uncommitted writes are never evicted.
+// Scripts may call in from any Guile thread, so the LRU and the reader connection sit behind cacheMutex.
+struct Storage {
+  struct Entry {
+    std::string key;
+    StorageDatum value;
+    uint64_t seq; // last queued write, 0 if clean
+  };
+
+  struct Op {
+    enum Kind { PUT, ERASE, EXEC, QUERY } kind;
+    std::string text; // key or SQL
+    std::vector<StorageDatum> params;
+    uint64_t seq;
+    std::function<void(StorageRows)> callback;
+  };
+
+  StatementCache reader, writer;
+  std::mutex cacheMutex; // lru, index and reader
+  std::list<Entry> lru;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  size_t capacity;
+
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  std::vector<Op> queue;
+  uint64_t queued = 0;
+  std::atomic<uint64_t> committed{ 0 };
+  bool stopping = false, flushing = false;
+  size_t batchSize                   = 256;
+  std::chrono::milliseconds interval = std::chrono::milliseconds(1000);
+  std::thread thread;
+
+  ~Storage();
+
+  static Storage *open(std::string const &path, size_t capacity = 4096); // nullptr on failure
+
+  StorageDatum get(std::string const &key);
+  void put(std::string const &key, StorageDatum value);
+  void erase(std::string const &key) { put(key, std::monostate{}); }
+  void execute(std::string const &sql, std::vector<StorageDatum> params);
+  // Runs on the background thread after every write queued before it; callback is called on that thread
+  void queryAsync(std::string const &sql, std::vector<StorageDatum> params, std::function<void(StorageRows)> callback);
+  // Runs a read-only statement on the reader connection (committed data only), false with error set on a bad statement
+  bool query(std::string const &sql, std::vector<StorageDatum> const &params, StorageRows &rows, std::string &error);
+  void flush(); // blocks until everything queued so far is committed
+  void close();
+
+private:
+  uint64_t enqueue(Op op);
+  void remember(std::string const &key, StorageDatum value, uint64_t seq);
+  void run();
+  bool commit(std::vector<Op> &batch); // false if the transaction was rolled back
+};
+
+namespace scm {
+template <> struct convertible<Storage *> : foreign_object_is_convertible<Storage *> {
+  static Storage *from_scm(SCM scm) {
+    auto storage = foreign_object_is_convertible<Storage *>::from_scm(scm);
+    if (!storage) scm_misc_error("storage", "Storage used after storage-close: ~S", scm_list_1(scm));
+    return storage;
+  }
+};
+} // namespace scm
@@ -2,6 +2,8 @@
 
 #include <StaticHook.h>
 
+#include "main.h"
+
 #include <list>
 #include <memory>
 
@@ -33,6 +35,12 @@ static int16_t count = 0;
 static int16_t tickcount = 0;
 static int16_t lasttickcount = 0;
 static uint64_t lastus = GetTimeUS_Linux();
+static uint64_t ticks = 0;
+
+static std::vector<std::function<void()>> postTickHandlers;
+
+uint64_t getCurrentTick() { return ticks; }
+void onPostTick(std::function<void()> callback) { postTickHandlers.push_back(callback); }
 
 TInstanceHook(void, _ZN5Level4tickEv, Level) {
   for (auto &it : tickHandlers)
@@ -49,6 +57,7 @@ TInstanceHook(void, _ZN5Level4tickEv, Level) {
     }
   }
   count++;
+  ticks++;
   tickcount++;
   if (auto now = GetTimeUS_Linux(); now - lastus >= 1000000) {
     lasttickcount = tickcount;
@@ -56,12 +65,15 @@ TInstanceHook(void, _ZN5Level4tickEv, Level) {
     lastus += 1000000;
   }
   original(this);
+  for (auto &handler : postTickHandlers) handler();
 }
 
 SCM_DEFINE_PUBLIC(c_get_tps, "get-tps", 0, 0, 0, (), "Get TPS") {
   return scm::to_scm(lasttickcount);
 }
 
+SCM_DEFINE_PUBLIC(c_current_tick, "current-tick", 0, 0, 0, (), "Get ticks elapsed since server start") { return scm::to_scm(ticks); }
+
 SCM_DEFINE_PUBLIC(c_set_interval, "interval-run", 2, 0, 0, (scm::val<uint> cycle, scm::callback<> fn), "setInterval") {
   auto it = tickHandlers.emplace(std::make_pair(cycle, FixedFunction{ (int16_t)(count % cycle), fn }));
   return SCM_UNSPECIFIED;
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <api.h>
+
+uint64_t getCurrentTick();
+void onPostTick(std::function<void()> callback);
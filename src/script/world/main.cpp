@@ -1,12 +1,20 @@
-// Deps: out/script_world.so: out/script_base.so out/script_nbt.so
+// Deps: out/script_world.so: out/script_base.so out/script_nbt.so out/script_tick.so
 #include "../base/main.h"
 #include "../nbt/main.h"
+#include "../tick/main.h"
+#include "main.h"
 
 #include <api.h>
+#include <minecraft/extra/MinecraftHandle.h>
 
-namespace scm {
-template <> struct convertible<Block *> : foreign_object_is_convertible<Block *> {};
-} // namespace scm
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <zlib.h>
 
 MAKE_FOREIGN_TYPE(Block *, "block");
 
@@ -44,6 +52,21 @@ struct BedrockBlocks {
   static Block *mAir;
 };
 
+// Block arguments accept a handle from block-type / get-block or a block name
+static Block const *blockFromScm(SCM value) {
+  if (SCM_IS_A_P(value, scm::foreign_type_convertible<Block *>::type())) return scm::from_scm<Block *>(value);
+  auto bl = BlockTypeRegistry::lookupByName(scm::from_scm<std::string>(value));
+  return bl ? bl->getBlockStateFromLegacyData(0) : nullptr;
+}
+
+SCM_DEFINE_PUBLIC(block_type, "block-type", 1, 1, 0, (scm::val<std::string> name, scm::val<int> data), "Resolve block name to a reusable handle") {
+  auto bl = BlockTypeRegistry::lookupByName(name);
+  if (!bl) return SCM_BOOL_F;
+  auto block = bl->getBlockStateFromLegacyData(data[0]);
+  if (!block) return SCM_BOOL_F;
+  return scm::to_scm(block);
+}
+
 SCM_DEFINE_PUBLIC(get_block_at, "get-block", 2, 0, 0, (scm::val<BlockPos> pos, scm::val<int> did), "Get Block") {
   auto dim = ServerCommand::mGame->getLevel().getDimension(DimensionId(did));
   if (!dim) return SCM_BOOL_F;
@@ -59,25 +82,25 @@ SCM_DEFINE_PUBLIC(get_block_player_at, "get-block/player", 2, 0, 0, (scm::val<Bl
   return scm::to_scm(source.getBlock(pos));
 }
 
-SCM_DEFINE_PUBLIC(set_block_at, "set-block", 3, 0, 0, (scm::val<BlockPos> pos, scm::val<int> did, scm::val<std::string> name), "Set block") {
+SCM_DEFINE_PUBLIC(set_block_at, "set-block", 3, 0, 0, (scm::val<BlockPos> pos, scm::val<int> did, SCM name), "Set block") {
   auto dim = ServerCommand::mGame->getLevel().getDimension(DimensionId(did));
   if (!dim) return SCM_BOOL_F;
   CommandAreaFactory factory{ *dim };
   auto area = factory.findArea(pos, false);
   if (!area) return SCM_BOOL_F;
   auto &source = area->getRegion();
-  auto bl      = BlockTypeRegistry::lookupByName(name);
-  if (!bl) return SCM_BOOL_F;
-  source.setBlock(pos, *bl->getBlockStateFromLegacyData(0), 3, nullptr);
+  auto block   = blockFromScm(name);
+  if (!block) return SCM_BOOL_F;
+  source.setBlock(pos, *block, 3, nullptr);
   return SCM_BOOL_T;
 }
 
 SCM_DEFINE_PUBLIC(set_block_player_at, "set-block/player", 3, 0, 0,
-                  (scm::val<BlockPos> pos, scm::val<ServerPlayer *> player, scm::val<std::string> name), "Set block") {
+                  (scm::val<BlockPos> pos, scm::val<ServerPlayer *> player, SCM name), "Set block") {
   auto &source = player->getRegion();
-  auto bl      = BlockTypeRegistry::lookupByName(name);
-  if (!bl) return SCM_BOOL_F;
-  source.setBlock(pos, *bl->getBlockStateFromLegacyData(0), 3, nullptr);
+  auto block   = blockFromScm(name);
+  if (!block) return SCM_BOOL_F;
+  source.setBlock(pos, *block, 3, nullptr);
   return SCM_BOOL_T;
 }
 
@@ -102,6 +125,720 @@ SCM_DEFINE_PUBLIC(block_name, "block-name", 1, 0, 0, (scm::val<Block *> block),
   return scm::to_scm(block->getLegacyBlock()->getFullName());
 }
 
+// Caches one CommandArea per chunk for repeated block access. Areas are only trusted for the tick
+// they were opened in, chunks may unload once the server thread leaves the script.
+struct Region {
+  int did;
+  Dimension *dim;
+  uint64_t tick;
+  std::unordered_map<uint64_t, std::unique_ptr<CommandArea>> areas;
+
+  Region(int did)
+      : did(did)
+      , dim(ServerCommand::mGame->getLevel().getDimension(DimensionId(did)))
+      , tick(getCurrentTick()) {}
+
+  BlockSource *source(BlockPos const &pos) {
+    if (auto now = getCurrentTick(); now != tick) {
+      areas.clear();
+      dim  = ServerCommand::mGame->getLevel().getDimension(DimensionId(did));
+      tick = now;
+    }
+    if (!dim) return nullptr;
+    // Misses are kept as null entries so unloaded chunks are looked up once per tick too
+    auto [it, inserted] = areas.try_emplace(((uint64_t)(uint32_t)(pos.x >> 4) << 32) | (uint32_t)(pos.z >> 4));
+    if (inserted) it->second = CommandAreaFactory{ *dim }.findArea(pos, false);
+    return it->second ? &it->second->getRegion() : nullptr;
+  }
+};
+
+namespace scm {
+template <> struct convertible<Region *> : foreign_object_is_convertible<Region *> {
+  static Region *from_scm(SCM scm) {
+    auto region = foreign_object_is_convertible<Region *>::from_scm(scm);
+    if (!region) scm_misc_error("region", "Region used after close-region: ~S", scm_list_1(scm));
+    return region;
+  }
+};
+} // namespace scm
+
+// CommandAreas must be released on the server thread, collected regions wait here for the next tick
+static std::mutex collectedRegionsMutex;
+static std::vector<Region *> collectedRegions;
+
+static void releaseCollectedRegions() {
+  std::vector<Region *> regions;
+  {
+    std::lock_guard lock(collectedRegionsMutex);
+    regions.swap(collectedRegions);
+  }
+  for (auto region : regions) delete region;
+}
+
+MAKE_FOREIGN_TYPE(Region *, "region", [](SCM s) {
+  auto region = (Region *)scm_foreign_object_ref(s, 0);
+  if (!region) return;
+  std::lock_guard lock(collectedRegionsMutex);
+  collectedRegions.push_back(region);
+});
+
+SCM_DEFINE_PUBLIC(open_region, "open-region", 1, 2, 0, (scm::val<int> did, scm::val<BlockPos> min, scm::val<BlockPos> max),
+                  "Open cached block access for dimension (optionally preloading the chunks between min and max)") {
+  auto region = new Region(did);
+  if (min() && max()) {
+    BlockPos from = min, to = max;
+    for (int x = std::min(from.x, to.x) >> 4; x <= std::max(from.x, to.x) >> 4; x++)
+      for (int z = std::min(from.z, to.z) >> 4; z <= std::max(from.z, to.z) >> 4; z++) region->source({ x << 4, from.y, z << 4 });
+  }
+  return scm::to_scm(region);
+}
+
+SCM_DEFINE_PUBLIC(close_region, "close-region", 1, 0, 0, (SCM region), "Release region now instead of when it is collected (closing twice is harmless)") {
+  scm_assert_foreign_object_type(scm::foreign_type_convertible<Region *>::type(), region);
+  delete (Region *)scm_foreign_object_ref(region, 0);
+  scm_foreign_object_set_x(region, 0, nullptr);
+  return SCM_UNSPECIFIED;
+}
+
+SCM_DEFINE_PUBLIC(region_get_block, "region-get-block", 2, 0, 0, (scm::val<Region *> region, scm::val<BlockPos> pos), "Get Block") {
+  BlockPos bpos = pos;
+  auto source   = region->source(bpos);
+  if (!source) return SCM_BOOL_F;
+  return scm::to_scm(source->getBlock(bpos));
+}
+
+SCM_DEFINE_PUBLIC(region_set_block, "region-set-block", 3, 0, 0, (scm::val<Region *> region, scm::val<BlockPos> pos, SCM name),
+                  "Set block") {
+  BlockPos bpos = pos;
+  auto source   = region->source(bpos);
+  if (!source) return SCM_BOOL_F;
+  auto block = blockFromScm(name);
+  if (!block) return SCM_BOOL_F;
+  source->setBlock(bpos, *block, 3, nullptr);
+  return SCM_BOOL_T;
+}
+
+SCM_DEFINE_PUBLIC(region_clear_block, "region-clear-block", 2, 0, 0, (scm::val<Region *> region, scm::val<BlockPos> pos), "Clear block") {
+  BlockPos bpos = pos;
+  auto source   = region->source(bpos);
+  if (!source) return SCM_BOOL_F;
+  source->setBlock(bpos, *BedrockBlocks::mAir, 3, nullptr);
+  return SCM_BOOL_T;
+}
+
+// Bulk edits walk the cuboid chunk by chunk (x, z, then y inside a chunk) so every chunk area is
+// looked up once per tick. When every block of the cuboid is overwritten only blocks on its faces
+// notify their neighbors, the interior is written with flag 2 (send to clients) since its neighbors
+// are being replaced as well. Replace leaves unmatched blocks alone, so it always notifies.
+struct Cuboid {
+  int x0, y0, z0, x1, y1, z1;
+
+  Cuboid(BlockPos const &a, BlockPos const &b)
+      : x0(std::min(a.x, b.x))
+      , y0(std::min(a.y, b.y))
+      , z0(std::min(a.z, b.z))
+      , x1(std::max(a.x, b.x))
+      , y1(std::max(a.y, b.y))
+      , z1(std::max(a.z, b.z)) {}
+
+  size_t volume() const { return size_t(x1 - x0 + 1) * size_t(y1 - y0 + 1) * size_t(z1 - z0 + 1); }
+  size_t index(int x, int y, int z) const { return (size_t(x - x0) * size_t(z1 - z0 + 1) + size_t(z - z0)) * size_t(y1 - y0 + 1) + size_t(y - y0); }
+  bool onFace(int x, int y, int z) const { return x == x0 || x == x1 || y == y0 || y == y1 || z == z0 || z == z1; }
+};
+
+struct ChunkMajorCursor {
+  Cuboid box;
+  int cx, cz, x, y, z;
+  bool done = false;
+
+  ChunkMajorCursor(Cuboid const &box)
+      : box(box)
+      , cx(box.x0 >> 4)
+      , cz(box.z0 >> 4) {
+    startChunk();
+  }
+
+  void startChunk() {
+    x = std::max(box.x0, cx << 4);
+    z = std::max(box.z0, cz << 4);
+    y = box.y0;
+  }
+
+  void next() {
+    if (++y <= box.y1) return;
+    y = box.y0;
+    if (++z <= std::min(box.z1, (cz << 4) + 15)) return;
+    z = std::max(box.z0, cz << 4);
+    if (++x <= std::min(box.x1, (cx << 4) + 15)) return;
+    if (++cz > box.z1 >> 4) {
+      cz = box.z0 >> 4;
+      if (++cx > box.x1 >> 4) {
+        done = true;
+        return;
+      }
+    }
+    startChunk();
+  }
+};
+
+// Schematic files are gzip streams of a header followed by one section per chunk column, in the same
+// order the bulk edit cursor walks the cuboid. Each section carries its own palette and bit-packed
+// indices, so neither export nor import ever holds more than one chunk column in memory.
+// The chunk alignment of the source is kept so import can replay the exact same order anywhere.
+//   header:  "MSCH" u8 version i32 sx sy sz u8 ax az
+//   section: u32 count u32 palette (u16 length, name, u8 data)... u8 bits u64 words...
+//            u32 entities (u32 index, u32 length, NBT)...          (version 2)
+// An empty name marks blocks that could not be read (unloaded chunks) and are skipped on import.
+// Block entities (chest contents, sign text...) are stored as binary NBT keyed by their index in the section.
+static constexpr char schematicMagic[4] = { 'M', 'S', 'C', 'H' };
+static constexpr uint8_t schematicVersion = 2;
+
+static uint8_t blockData(Block const *block) {
+  static std::unordered_map<Block const *, uint8_t> cache;
+  auto [it, inserted] = cache.try_emplace(block, 0);
+  if (inserted) {
+    auto legacy = block->getLegacyBlock();
+    for (int data = 0; data < 16; data++)
+      if (legacy->getBlockStateFromLegacyData(data) == block) {
+        it->second = data;
+        break;
+      }
+  }
+  return it->second;
+}
+
+// BlockEntity's virtual layout is not declared here. save and load are called through the slot the base
+// implementation occupies in BlockEntity's own vtable, so chests, signs and the like dispatch to their override.
+static int blockEntitySlot(char const *symbol) {
+  auto table  = (void **)dlsym(MinecraftHandle(), "_ZTV11BlockEntity");
+  auto method = dlsym(MinecraftHandle(), symbol);
+  if (table && method)
+    for (int i = 2; i < 64; i++)
+      if (table[i] == method) return i - 2; // objects point past offset-to-top and typeinfo
+  Log::warn("world", "%s not found, schematics skip block entities", symbol);
+  return -1;
+}
+
+static bool saveBlockEntity(BlockEntity *entity, CompoundTag &tag) {
+  static int slot = blockEntitySlot("_ZNK11BlockEntity4saveER11CompoundTag");
+  if (slot < 0) return false;
+  return ((bool (*)(BlockEntity *, CompoundTag &))(*(void ***)entity)[slot])(entity, tag);
+}
+
+// The saved position is rewritten to where the block was placed
+static void loadBlockEntity(BlockEntity *entity, CompoundTag const &tag, BlockPos const &pos) {
+  static int slot = blockEntitySlot("_ZN11BlockEntity4loadERK11CompoundTag");
+  if (slot < 0) return;
+  auto moved = tag.copy();
+  auto &fields = static_cast<CompoundTag &>(*moved).value;
+  for (auto [key, value] : { std::pair{ "x", pos.x }, std::pair{ "y", pos.y }, std::pair{ "z", pos.z } })
+    if (auto it = fields.find(key); it != fields.end() && it->second && it->second->getId() == TAG_INT) static_cast<IntTag &>(*it->second).value = value;
+  ((void (*)(BlockEntity *, CompoundTag const &))(*(void ***)entity)[slot])(entity, static_cast<CompoundTag &>(*moved));
+  entity->setChanged();
+}
+
+// Write errors are sticky; close reports whether everything reached the disk
+struct SchematicWriter {
+  gzFile file;
+  bool ok = true;
+  std::vector<Block const *> palette;
+  std::unordered_map<Block const *, uint32_t> ids;
+  std::vector<uint32_t> indices;
+  std::vector<std::pair<uint32_t, std::string>> entities;
+
+  SchematicWriter(gzFile file, Cuboid const &box)
+      : file(file) {
+    write(schematicMagic, sizeof schematicMagic);
+    put(schematicVersion);
+    put<int32_t>(box.x1 - box.x0 + 1);
+    put<int32_t>(box.y1 - box.y0 + 1);
+    put<int32_t>(box.z1 - box.z0 + 1);
+    put<uint8_t>(box.x0 & 15);
+    put<uint8_t>(box.z0 & 15);
+  }
+  ~SchematicWriter() {
+    if (file) gzclose(file);
+  }
+
+  void write(void const *data, size_t size) {
+    if (ok && size && gzwrite(file, data, size) != (int)size) ok = false;
+  }
+  template <typename T> void put(T const &value) { write(&value, sizeof value); }
+
+  bool close() {
+    auto rc = gzclose(file);
+    file    = nullptr;
+    return ok && rc == Z_OK;
+  }
+
+  void push(Block const *block, BlockEntity *entity) {
+    auto [it, inserted] = ids.try_emplace(block, palette.size());
+    if (inserted) palette.push_back(block);
+    if (entity) {
+      CompoundTag tag;
+      std::string nbt;
+      if (saveBlockEntity(entity, tag) && writeNbt(tag, nbt)) entities.emplace_back(indices.size(), std::move(nbt));
+    }
+    indices.push_back(it->second);
+  }
+
+  void flush() {
+    if (indices.empty()) return;
+    put<uint32_t>(indices.size());
+    put<uint32_t>(palette.size());
+    for (auto block : palette) {
+      auto name = block ? block->getLegacyBlock()->getFullName() : std::string{};
+      put<uint16_t>(name.size());
+      write(name.data(), name.size());
+      put<uint8_t>(block ? blockData(block) : 0);
+    }
+    uint8_t bits = 1;
+    while ((1ull << bits) < palette.size()) bits++;
+    put(bits);
+    auto perWord = 64 / bits;
+    std::vector<uint64_t> words((indices.size() + perWord - 1) / perWord);
+    for (size_t i = 0; i < indices.size(); i++) words[i / perWord] |= (uint64_t)indices[i] << (i % perWord * bits);
+    write(words.data(), words.size() * sizeof(uint64_t));
+    put<uint32_t>(entities.size());
+    for (auto &[index, nbt] : entities) {
+      put<uint32_t>(index);
+      put<uint32_t>(nbt.size());
+      write(nbt.data(), nbt.size());
+    }
+    palette.clear();
+    ids.clear();
+    indices.clear();
+    entities.clear();
+  }
+};
+
+struct SchematicReader {
+  gzFile file;
+  uint8_t version = 0;
+  int32_t sx = 0, sy = 0, sz = 0;
+  uint8_t ax = 0, az = 0;
+  std::vector<Block const *> palette;
+  std::vector<uint64_t> words;
+  std::unordered_map<uint32_t, std::unique_ptr<Tag>> entities;
+  uint32_t count = 0, pos = 0;
+  uint8_t bits = 1;
+  bool failed  = false;
+
+  SchematicReader(gzFile file)
+      : file(file) {}
+  ~SchematicReader() { gzclose(file); }
+
+  template <typename T> bool get(T &value) { return gzread(file, &value, sizeof value) == sizeof value; }
+
+  bool readHeader() {
+    char magic[4];
+    if (gzread(file, magic, sizeof magic) != sizeof magic || memcmp(magic, schematicMagic, sizeof magic)) return false;
+    if (!get(version) || version == 0 || version > schematicVersion) return false;
+    return get(sx) && get(sy) && get(sz) && get(ax) && get(az) && sx > 0 && sy > 0 && sz > 0 && ax < 16 && az < 16;
+  }
+
+  // Parses into locals and only then replaces the current section, a short read leaves failed set
+  bool readSection() {
+    uint32_t total, size;
+    uint8_t width;
+    if (!get(total) || !get(size) || total == 0) return fail();
+    std::vector<Block const *> nextPalette;
+    std::string name;
+    for (uint32_t i = 0; i < size; i++) {
+      uint16_t length;
+      uint8_t data;
+      if (!get(length)) return fail();
+      name.resize(length);
+      if (gzread(file, name.data(), length) != length || !get(data)) return fail();
+      Block const *block = nullptr;
+      if (auto legacy = length ? BlockTypeRegistry::lookupByName(name) : nullptr) {
+        block = legacy->getBlockStateFromLegacyData(data);
+        if (!block) block = legacy->getBlockStateFromLegacyData(0);
+      }
+      nextPalette.push_back(block);
+    }
+    if (!get(width) || width == 0 || width > 32) return fail();
+    auto perWord = 64 / width;
+    std::vector<uint64_t> nextWords((total + perWord - 1) / perWord);
+    int bytes = nextWords.size() * sizeof(uint64_t);
+    if (gzread(file, nextWords.data(), bytes) != bytes) return fail();
+    std::unordered_map<uint32_t, std::unique_ptr<Tag>> nextEntities;
+    if (version >= 2) {
+      uint32_t stored;
+      if (!get(stored)) return fail();
+      std::string nbt;
+      for (uint32_t i = 0; i < stored; i++) {
+        uint32_t index, length;
+        if (!get(index) || !get(length)) return fail();
+        nbt.resize(length);
+        if (gzread(file, nbt.data(), length) != (int)length) return fail();
+        if (auto tag = readNbt(nbt.data(), nbt.size()); tag && tag->getId() == TAG_COMPOUND) nextEntities[index] = std::move(tag);
+      }
+    }
+    count    = total;
+    bits     = width;
+    palette  = std::move(nextPalette);
+    words    = std::move(nextWords);
+    entities = std::move(nextEntities);
+    pos      = 0;
+    return true;
+  }
+
+  bool fail() {
+    failed = true;
+    return false;
+  }
+
+  // Next block in cursor order, nullptr for skipped blocks; a truncated or corrupt file sets failed
+  Block const *next() {
+    if (failed || (pos == count && !readSection())) return nullptr;
+    auto perWord = 64 / bits;
+    auto i       = pos++;
+    auto index   = (words[i / perWord] >> (i % perWord * bits)) & ((1ull << bits) - 1);
+    return index < palette.size() ? palette[index] : nullptr;
+  }
+
+  // Block entity saved with the block last returned by next
+  CompoundTag const *entity() const {
+    auto it = entities.find(pos - 1);
+    return it != entities.end() ? static_cast<CompoundTag const *>(it->second.get()) : nullptr;
+  }
+};
+
+struct EditJob {
+  enum Kind { FILL, REPLACE, COPY, EXPORT, IMPORT, WRITE } kind;
+  Region region;
+  Cuboid target;
+  Cuboid from;
+  ChunkMajorCursor cursor;
+  int dx = 0, dy = 0, dz = 0;           // import walks a box aligned like the source, shifted onto target
+  Block const *block       = nullptr; // fill / replace with
+  BlockLegacy const *match = nullptr; // replace only this type
+  bool reading             = false;   // copy snapshots the source first, so overlapping copies stay intact
+  std::vector<Block *> buffer;
+  std::unique_ptr<SchematicWriter> writer;
+  std::unique_ptr<SchematicReader> reader;
+  std::vector<BlockWrite> writes;
+  size_t changed = 0;
+  SCM callback;
+
+  EditJob(Kind kind, int did, Cuboid const &target, Cuboid const &from, SCM callback)
+      : kind(kind)
+      , region(did)
+      , target(target)
+      , from(from)
+      , cursor(kind == COPY || kind == EXPORT || kind == IMPORT ? from : target)
+      , callback(callback) {
+    if (kind == IMPORT) {
+      dx = target.x0 - from.x0;
+      dy = target.y0 - from.y0;
+      dz = target.z0 - from.z0;
+    }
+    if (kind == COPY) buffer.resize(from.volume());
+    reading = kind == COPY || kind == EXPORT;
+    scm_gc_protect_object(callback);
+  }
+  ~EditJob() { scm_gc_unprotect_object(callback); }
+
+  // Processes one block, returns false once the job is finished
+  bool step() {
+    if (kind == WRITE) {
+      auto &write = writes[changed++];
+      BlockPos pos{ write.x, write.y, write.z };
+      if (auto bs = region.source(pos)) bs->setBlock(pos, *write.block, 3, nullptr);
+      return changed < writes.size();
+    }
+    int x = cursor.x + dx, y = cursor.y + dy, z = cursor.z + dz;
+    BlockPos pos{ x, y, z };
+    auto bs = region.source(pos);
+    if (reading) {
+      Block *current = bs ? bs->getBlock(pos) : nullptr;
+      if (writer) {
+        writer->push(current, bs && current ? bs->getBlockEntity(pos) : nullptr);
+        changed++;
+      } else {
+        buffer[from.index(cursor.x, cursor.y, cursor.z)] = current;
+      }
+    } else {
+      Block const *next = block;
+      if (kind == COPY) next = buffer[target.index(x, y, z)];
+      if (kind == IMPORT) {
+        next = reader->next(); // consumed even when the chunk is missing to stay in step with the file
+        if (reader->failed) return false;
+      }
+      if (bs && next && kind == REPLACE && bs->getBlock(pos)->getLegacyBlock() != match) next = nullptr;
+      if (bs && next) {
+        bs->setBlock(pos, *next, kind == REPLACE || target.onFace(x, y, z) ? 3 : 2, nullptr);
+        if (kind == IMPORT)
+          if (auto tag = reader->entity())
+            if (auto entity = bs->getBlockEntity(pos)) loadBlockEntity(entity, *tag, pos);
+        changed++;
+      }
+    }
+    auto cx = cursor.cx, cz = cursor.cz;
+    cursor.next();
+    if (writer && (cursor.done || cursor.cx != cx || cursor.cz != cz)) {
+      writer->flush();
+      if (!writer->ok) return false;
+    }
+    if (!cursor.done) return true;
+    if (!reading || writer) return false;
+    reading = false;
+    cursor  = ChunkMajorCursor(target);
+    return true;
+  }
+};
+
+// copy-region snapshots the whole source, larger copies have to go through a schematic file
+static constexpr size_t maxCopyVolume = 1 << 22;
+
+static std::list<std::unique_ptr<EditJob>> editJobs;
+static uint64_t editBudget = 5000; // microseconds per tick
+
+static void runEditJobs() {
+  if (editJobs.empty()) return;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(editBudget);
+  while (!editJobs.empty()) {
+    auto &job = editJobs.front();
+    bool more = true;
+    for (int i = 0; more && i < 256; i++) more = job->step();
+    if (!more) {
+      auto done = std::move(job);
+      editJobs.pop_front();
+      SCM result = scm::to_scm(done->changed);
+      if (done->writer && !done->writer->close()) {
+        Log::error("world", "Cannot write schematic, export of %zu blocks failed", done->changed);
+        result = SCM_BOOL_F;
+      }
+      if (done->reader && done->reader->failed) {
+        Log::error("world", "Schematic is truncated or corrupt, import stopped after %zu blocks", done->changed);
+        result = SCM_BOOL_F;
+      }
+      if (scm_is_true(done->callback)) scm_call_1(done->callback, result);
+    }
+    if (std::chrono::steady_clock::now() >= deadline) break;
+  }
+}
+
+static SCM queueEdit(std::unique_ptr<EditJob> job) {
+  auto volume = job->reading ? job->from.volume() : job->target.volume();
+  editJobs.emplace_back(std::move(job));
+  return scm::to_scm(volume);
+}
+
+size_t queueBlockWrites(int did, std::vector<BlockWrite> writes, SCM callback) {
+  if (writes.empty()) return 0;
+  std::stable_sort(writes.begin(), writes.end(), [](BlockWrite const &a, BlockWrite const &b) {
+    return std::make_pair(a.x >> 4, a.z >> 4) < std::make_pair(b.x >> 4, b.z >> 4); // chunk-major like the cuboid jobs
+  });
+  Cuboid box{ { writes.front().x, writes.front().y, writes.front().z }, { writes.front().x, writes.front().y, writes.front().z } };
+  auto job    = std::make_unique<EditJob>(EditJob::WRITE, did, box, box, callback);
+  job->writes = std::move(writes);
+  auto size   = job->writes.size();
+  editJobs.emplace_back(std::move(job));
+  return size;
+}
+
+SCM_DEFINE_PUBLIC(fill_region, "fill-region", 4, 1, 0,
+                  (scm::val<int> did, scm::val<BlockPos> min, scm::val<BlockPos> max, SCM name, SCM callback),
+                  "Fill cuboid with block over the next ticks, callback receives the number of changed blocks") {
+  auto block = blockFromScm(name);
+  if (!block) return SCM_BOOL_F;
+  Cuboid box{ min, max };
+  auto job   = std::make_unique<EditJob>(EditJob::FILL, did, box, box, SCM_UNBNDP(callback) ? SCM_BOOL_F : callback);
+  job->block = block;
+  return queueEdit(std::move(job));
+}
+
+SCM_DEFINE_PUBLIC(replace_region, "replace-region", 5, 1, 0,
+                  (scm::val<int> did, scm::val<BlockPos> min, scm::val<BlockPos> max, SCM from, SCM to, SCM callback),
+                  "Replace every block of type from with to inside cuboid over the next ticks") {
+  auto match = blockFromScm(from);
+  auto block = blockFromScm(to);
+  if (!match || !block) return SCM_BOOL_F;
+  Cuboid box{ min, max };
+  auto job   = std::make_unique<EditJob>(EditJob::REPLACE, did, box, box, SCM_UNBNDP(callback) ? SCM_BOOL_F : callback);
+  job->block = block;
+  job->match = match->getLegacyBlock();
+  return queueEdit(std::move(job));
+}
+
+SCM_DEFINE_PUBLIC(copy_region, "copy-region", 4, 1, 0,
+                  (scm::val<int> did, scm::val<BlockPos> min, scm::val<BlockPos> max, scm::val<BlockPos> dest, SCM callback),
+                  "Copy cuboid so its lower corner lands on dest over the next ticks") {
+  Cuboid from{ min, max };
+  if (from.volume() > maxCopyVolume)
+    scm_misc_error("copy-region", "Region of ~A blocks is too large to copy (limit ~A), use export-schematic and import-schematic",
+                   scm::list(from.volume(), maxCopyVolume));
+  BlockPos to = dest;
+  Cuboid target{ to, { to.x + from.x1 - from.x0, to.y + from.y1 - from.y0, to.z + from.z1 - from.z0 } };
+  return queueEdit(std::make_unique<EditJob>(EditJob::COPY, did, target, from, SCM_UNBNDP(callback) ? SCM_BOOL_F : callback));
+}
+
+SCM_DEFINE_PUBLIC(export_schematic, "export-schematic", 4, 1, 0,
+                  (scm::val<int> did, scm::val<BlockPos> min, scm::val<BlockPos> max, scm::val<std::string> path, SCM callback),
+                  "Save cuboid to a schematic file over the next ticks, callback receives #f if writing failed") {
+  auto file = gzopen(path.get().c_str(), "wb");
+  if (!file) return SCM_BOOL_F;
+  Cuboid box{ min, max };
+  auto job    = std::make_unique<EditJob>(EditJob::EXPORT, did, box, box, SCM_UNBNDP(callback) ? SCM_BOOL_F : callback);
+  job->writer = std::make_unique<SchematicWriter>(file, box);
+  if (!job->writer->ok) {
+    job.reset();
+    scm_misc_error("export-schematic", "Cannot write ~A", scm_list_1(path.scm));
+  }
+  return queueEdit(std::move(job));
+}
+
+SCM_DEFINE_PUBLIC(import_schematic, "import-schematic", 3, 1, 0, (scm::val<int> did, scm::val<BlockPos> dest, scm::val<std::string> path, SCM callback),
+                  "Place schematic file with its lower corner on dest over the next ticks, callback receives #f if the file is truncated") {
+  auto file = gzopen(path.get().c_str(), "rb");
+  if (!file) return SCM_BOOL_F;
+  auto reader = std::make_unique<SchematicReader>(file);
+  if (!reader->readHeader()) return SCM_BOOL_F;
+  BlockPos to = dest;
+  Cuboid target{ to, { to.x + reader->sx - 1, to.y + reader->sy - 1, to.z + reader->sz - 1 } };
+  Cuboid from{ { reader->ax, 0, reader->az }, { reader->ax + reader->sx - 1, reader->sy - 1, reader->az + reader->sz - 1 } };
+  auto job    = std::make_unique<EditJob>(EditJob::IMPORT, did, target, from, SCM_UNBNDP(callback) ? SCM_BOOL_F : callback);
+  job->reader = std::move(reader);
+  return queueEdit(std::move(job));
+}
+
+SCM_DEFINE_PUBLIC(pending_edits, "pending-edits", 0, 0, 0, (), "Get number of queued bulk edits") { return scm::to_scm(editJobs.size()); }
+
+SCM_DEFINE_PUBLIC(set_edit_budget, "set-edit-budget!", 1, 0, 0, (scm::val<uint64_t> us), "Set time spent on bulk edits per tick (microseconds)") {
+  editBudget = us;
+  return SCM_UNSPECIFIED;
+}
+
+// Online players bucketed by dimension and chunk column. The grid is rebuilt in one pass on the first
+// query of a tick (or after the player list changed), later queries of the same tick only visit the
+// cells overlapping their box.
+struct PlayerGrid {
+  struct Entry {
+    ServerPlayer *player;
+    float x, y, z;
+  };
+
+  uint64_t tick = UINT64_MAX;
+  std::shared_ptr<PlayerList const> snapshot;
+  std::unordered_map<uint64_t, std::vector<Entry>> cells;
+
+  static uint64_t cellKey(int dim, int cx, int cz) {
+    return ((uint64_t)(uint8_t)dim << 56) | ((uint64_t)((uint32_t)cx & 0xFFFFFFF) << 28) | ((uint32_t)cz & 0xFFFFFFF);
+  }
+
+  void refresh() {
+    auto list = getPlayerList();
+    auto now  = getCurrentTick();
+    if (now == tick && list == snapshot) return;
+    tick     = now;
+    snapshot = list;
+    cells.clear();
+    for (auto const &entry : *list) {
+      auto &pos = entry.player->getPos();
+      cells[cellKey(entry.player->getDimensionId(), (int)floorf(pos.x) >> 4, (int)floorf(pos.z) >> 4)].push_back({ entry.player, pos.x, pos.y, pos.z });
+    }
+  }
+
+  // Boxes spanning more cells than are occupied walk the occupied cells instead
+  template <typename F> void query(int dim, Vec3 const &min, Vec3 const &max, F f) {
+    refresh();
+    auto visit = [&](std::vector<Entry> const &cell) {
+      for (auto &entry : cell)
+        if (entry.x >= min.x && entry.x <= max.x && entry.y >= min.y && entry.y <= max.y && entry.z >= min.z && entry.z <= max.z) f(entry);
+    };
+    int cx0 = (int)floorf(min.x) >> 4, cx1 = (int)floorf(max.x) >> 4;
+    int cz0 = (int)floorf(min.z) >> 4, cz1 = (int)floorf(max.z) >> 4;
+    if (double(cx1 - cx0 + 1) * double(cz1 - cz0 + 1) > cells.size()) {
+      for (auto &[key, cell] : cells)
+        if (key >> 56 == (uint8_t)dim) visit(cell);
+      return;
+    }
+    for (int cx = cx0; cx <= cx1; cx++)
+      for (int cz = cz0; cz <= cz1; cz++)
+        if (auto it = cells.find(cellKey(dim, cx, cz)); it != cells.end()) visit(it->second);
+  }
+};
+
+static PlayerGrid playerGrid;
+
+static SCM collectPlayers(int did, Vec3 const &min, Vec3 const &max, Vec3 const *center, float radius) {
+  std::vector<ServerPlayer *> found;
+  playerGrid.query(did, min, max, [&](PlayerGrid::Entry const &entry) {
+    if (center) {
+      auto dx = entry.x - center->x, dy = entry.y - center->y, dz = entry.z - center->z;
+      if (dx * dx + dy * dy + dz * dz > radius * radius) return;
+    }
+    found.push_back(entry.player);
+  });
+  SCM vec = scm_c_make_vector(found.size(), SCM_BOOL_F);
+  for (size_t i = 0; i < found.size(); i++) scm_c_vector_set_x(vec, i, scm::to_scm(found[i]));
+  return vec;
+}
+
+SCM_DEFINE_PUBLIC(players_within, "players-within", 3, 0, 0, (scm::val<int> did, scm::val<Vec3> center, scm::val<float> radius),
+                  "Get vector of players within radius of center") {
+  Vec3 c = center;
+  float r = radius;
+  return collectPlayers(did, { c.x - r, c.y - r, c.z - r }, { c.x + r, c.y + r, c.z + r }, &c, r);
+}
+
+SCM_DEFINE_PUBLIC(players_within_box, "players-within/box", 3, 0, 0, (scm::val<int> did, scm::val<Vec3> min, scm::val<Vec3> max),
+                  "Get vector of players inside box") {
+  Vec3 a = min, b = max;
+  return collectPlayers(did, { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }, { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) },
+                        nullptr, 0);
+}
+
+struct AABB {
+  Vec3 min, max;
+  bool empty;
+};
+
+// Actors are already kept per chunk by the game, so the box query is delegated to it one loaded chunk
+// column at a time (unloaded ones are skipped). Actors straddling a column border are reported once.
+static SCM collectActors(int did, Vec3 const &min, Vec3 const &max, Vec3 const *center, float radius) {
+  static auto fetchEntities =
+      (std::vector<Actor *> & (*)(BlockSource *, Actor *, AABB const &)) dlsym(MinecraftHandle(), "_ZN11BlockSource13fetchEntitiesEP5ActorRK4AABB");
+  if (!fetchEntities) scm_misc_error("actors-within", "BlockSource::fetchEntities is not available", SCM_EOL);
+  Region region{ did };
+  std::vector<Actor *> found;
+  std::unordered_set<Actor *> seen;
+  for (int cx = (int)floorf(min.x) >> 4; cx <= (int)floorf(max.x) >> 4; cx++)
+    for (int cz = (int)floorf(min.z) >> 4; cz <= (int)floorf(max.z) >> 4; cz++) {
+      auto source = region.source({ cx << 4, (int)floorf(min.y), cz << 4 });
+      if (!source) continue;
+      Vec3 lo{ std::max(min.x, (float)(cx << 4)), min.y, std::max(min.z, (float)(cz << 4)) };
+      Vec3 hi{ std::min(max.x, (float)((cx << 4) + 16)), max.y, std::min(max.z, (float)((cz << 4) + 16)) };
+      for (auto actor : fetchEntities(source, nullptr, AABB{ lo, hi, false })) {
+        if (center) {
+          auto &pos = actor->getPos();
+          auto dx = pos.x - center->x, dy = pos.y - center->y, dz = pos.z - center->z;
+          if (dx * dx + dy * dy + dz * dz > radius * radius) continue;
+        }
+        if (seen.insert(actor).second) found.push_back(actor);
+      }
+    }
+  SCM vec = scm_c_make_vector(found.size(), SCM_BOOL_F);
+  for (size_t i = 0; i < found.size(); i++) scm_c_vector_set_x(vec, i, scm::to_scm(found[i]));
+  return vec;
+}
+
+SCM_DEFINE_PUBLIC(actors_within, "actors-within", 3, 0, 0, (scm::val<int> did, scm::val<Vec3> center, scm::val<float> radius),
+                  "Get vector of actors within radius of center") {
+  Vec3 c = center;
+  float r = radius;
+  return collectActors(did, { c.x - r, c.y - r, c.z - r }, { c.x + r, c.y + r, c.z + r }, &c, r);
+}
+
+SCM_DEFINE_PUBLIC(actors_within_box, "actors-within/box", 3, 0, 0, (scm::val<int> did, scm::val<Vec3> min, scm::val<Vec3> max),
+                  "Get vector of actors inside box") {
+  Vec3 a = min, b = max;
+  return collectActors(did, { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }, { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) },
+                       nullptr, 0);
+}
+
 SCM_DEFINE_PUBLIC(spawn_actor, "spawn-actor", 3, 0, 0, (scm::val<Vec3> pos, scm::val<int> did, scm::val<std::string> name), "Spawn actor") {
   auto dim = ServerCommand::mGame->getLevel().getDimension(DimensionId(did));
   if (!dim) return SCM_BOOL_F;
@@ -129,8 +866,8 @@ SCM_DEFINE_PUBLIC(player_spawn_actor, "spawn-actor/player", 3, 0, 0,
 }
 
 SCM_DEFINE_PUBLIC(create_item_instance, "create-item-instance", 2, 2, 0,
-                  (scm::val<std::string> name, scm::val<int> number, scm::val<int> aux, scm::val<CompoundTag *> tag), "Create ItemInstance") {
-  auto item = ItemRegistry::lookupByName(name, true);
+                  (SCM name, scm::val<int> number, scm::val<int> aux, scm::val<CompoundTag *> tag), "Create ItemInstance") {
+  auto item = itemFromScm(name);
   if (!item) return SCM_BOOL_F;
   return scm::to_scm(new ItemInstance(*item, number, aux[0], tag[nullptr]));
 }
@@ -168,8 +905,15 @@ SCM_DEFINE_PUBLIC(player_spawn_item, "spawn-item/player", 3, 0, 0,
   return scm::to_scm(ret);
 }
 
+LOADFILE(preload, "src/script/world/preload.scm");
+
 PRELOAD_MODULE("minecraft world") {
 #ifndef DIAG
 #include "main.x"
+#include "preload.scm.z"
 #endif
+
+  scm_c_eval_string(&file_preload_start);
+  onPostTick(runEditJobs);
+  onPostTick(releaseCollectedRegions);
 }
\ No newline at end of file
@@ -0,0 +1,13 @@
+#include <api.h>
+
+namespace scm {
+template <> struct convertible<Block *> : foreign_object_is_convertible<Block *> {};
+} // namespace scm
+
+struct BlockWrite {
+  int x, y, z;
+  Block const *block;
+};
+
+// Queue scattered block writes on the budgeted bulk edit path, callback (or #f) receives the number written
+size_t queueBlockWrites(int did, std::vector<BlockWrite> writes, SCM callback);
@@ -0,0 +1,7 @@
+(define (with-region dim min max proc)
+        (let [(region (open-region dim min max))]
+             (dynamic-wind (lambda () #t)
+                           (lambda () (proc region))
+                           (lambda () (close-region region)))))
+
+(export with-region)
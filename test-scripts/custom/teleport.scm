@@ -5,6 +5,7 @@
                #:use-module (minecraft form)
                #:use-module (minecraft tick)
                #:use-module (minecraft chat)
+               #:use-module (minecraft cooldown)
 
                #:use-module (utils form)
                #:use-module (megacut)
@@ -42,8 +43,8 @@
                                       (make-simple-form "Hello" "world" "Done" "Dismiss")
                                       (lambda (x) x))))
 
-(define tp-cooldown-list '())
 (define tp-cooldown 1000)
+(define tp-cooldowns (make-cooldown tp-cooldown))
 
 (define (set-teleport-cooldown! value) (set! tp-cooldown value))
 
@@ -58,7 +59,7 @@
              0
              (list (command-vtable (list (parameter-selector "target" #t))
                                    (checked-player! self
-                                                    (match (cons (lset<= uuid=? (list (player-uuid self)) tp-cooldown-list) (command-args))
+                                                    (match (cons (cooldown-active? tp-cooldowns self) (command-args))
                                                           [(#t _) (outp-error "Waiting for teleport cooldown")]
                                                           [(#f (target)) (send-form target
                                                                                     (make-simple-form "Teleport request" (format #f "From ~a" (actor-name self)))
@@ -66,9 +67,7 @@
                                                                                         (begin (tp self target)
                                                                                                (send-message self "Teleported."))
                                                                                         (send-message self "Request rejected.")))
-                                                                         (let [(uuid (player-uuid self))]
-                                                                               (set! tp-cooldown-list (lset-adjoin uuid=? tp-cooldown-list uuid))
-                                                                               (delay-run! tp-cooldown (set! tp-cooldown-list (lset-difference uuid=? tp-cooldown-list (list uuid)))))
+                                                                         (cooldown-set! tp-cooldowns self tp-cooldown)
                                                                          (outp-success "Request sent.")]
                                                           [_ (outp-error "Must have 1 player selected")])))))
 
@@ -77,7 +76,7 @@
              0
              (list (command-vtable (list (parameter-selector "target" #t))
                                    (checked-player! self
-                                                    (match (cons (lset<= uuid=? (list (player-uuid self)) tp-cooldown-list) (command-args))
+                                                    (match (cons (cooldown-active? tp-cooldowns self) (command-args))
                                                           [(#t _) (outp-error "Waiting for teleport cooldown")]
                                                           [(#f (target)) (send-form target
                                                                                     (make-simple-form "Teleport request" (format #f "To ~a" (actor-name self)))
@@ -85,8 +84,6 @@
                                                                                         (begin (tp target self)
                                                                                                (send-message self "Teleported."))
                                                                                         (send-message self "Request rejected.")))
-                                                                         (let [(uuid (player-uuid self))]
-                                                                               (set! tp-cooldown-list (lset-adjoin uuid=? tp-cooldown-list uuid))
-                                                                               (delay-run! tp-cooldown (set! tp-cooldown-list (lset-difference uuid=? tp-cooldown-list (list uuid)))))
+                                                                         (cooldown-set! tp-cooldowns self tp-cooldown)
                                                                          (outp-success "Request sent.")]
                                                           [_ (outp-error "Must have 1 player selected")])))))
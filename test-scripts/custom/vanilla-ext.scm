@@ -11,54 +11,7 @@
                
                #:export (init-player-trace))
 
-(define particles
-        `("none"
-          "bubble"
-          "crit"
-          "smoke"
-          "explode"
-          "evaporation"
-          "flame"
-          "lava"
-          "largesmoke"
-          "redust"
-          "iconcrack"
-          "snowballpoof"
-          "largeexplode"
-          "hugeexplosion"
-          "mobflame"
-          "heart"
-          "terrain"
-          "townaura"
-          "portal"
-          "watersplash"
-          "waterwake"
-          "dripwater"
-          "driplava"
-          "fallingdust"
-          "mobspell"
-          "mobspellambient"
-          "mobspellinstantaneous"
-          "ink"
-          "slime"
-          "rainsplash"
-          "villagerangry"
-          "villagerhappy"
-          "enchantingtable"
-          "trackingemitter"
-          "note"
-          "witchspell"
-          "carrotboost"
-          "dragonbreath"
-          "spit"
-          "totem"
-          "food"
-          "conduit"
-          "bubblecolumnup"
-          "bubblecolumndown"
-          
-          "forcefield"
-          "risingreddust"))
+(define particles (particle-names))
 
 (define particle-enum (apply parameter-enum "particle" "ParticleType" particles))
 
@@ -72,11 +25,14 @@
                                  #%(match (command-args)
                                          [(name pos data) (fake-particle name pos (orig-dim) data) (outp-success (format #f "~a ~a ~a ~a" name pos (orig-dim) data))]))))
 
-(define trace-particle "portal")
+; Kept as a name, queue-particle resolves it through the particle table once the game is running
+(define trace-particle 'portal)
 (define trace-fix 1.6)
 
 (define* (fix-pos pos #:optional (fix 1.6)) (f32vector-set! pos 1 (- (f32vector-ref pos 1) fix)) pos)
 
 (define (init-player-trace name fix) (set! trace-particle name) (set! trace-fix fix))
 
-(interval-run! 1 (for-each-player! player (fake-particle trace-particle (fix-pos (actor-pos player) trace-fix) (actor-dim player) 1)))
\ No newline at end of file
+(define trace-pos (make-f32vector 3 0))
+
+(interval-run! 1 (for-each-player! player (queue-particle trace-particle (fix-pos (actor-pos! player trace-pos) trace-fix) (actor-dim player) 1)))
\ No newline at end of file
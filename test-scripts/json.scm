@@ -1,41 +1,26 @@
-;;; (json) --- Guile JSON implementation.
-
-;; Copyright (C) 2013-2018 Aleix Conchillo Flaque <aconchillo@gmail.com>
-;;
-;; This file is part of guile-json.
-;;
-;; guile-json is free software: you can redistribute it and/or modify
-;; it under the terms of the GNU General Public License as published by
-;; the Free Software Foundation; either version 3 of the License, or
-;; (at your option) any later version.
-;;
-;; guile-json is distributed in the hope that it will be useful, but
-;; WITHOUT ANY WARRANTY; without even the implied warranty of
-;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
-;; General Public License for more details.
-;;
-;; You should have received a copy of the GNU General Public License
-;; along with guile-json. If not, see https://www.gnu.org/licenses/.
-
-;;; Commentary:
-
-;; JSON module for Guile
-
-;;; Code:
+;;; (json) --- guile-json compatible interface over the native (minecraft json) codec
 
 (define-module (json)
-  #:use-module (json builder)
-  #:use-module (json parser))
-
-(define-syntax re-export-modules
-  (syntax-rules ()
-    ((_ (mod ...) ...)
-     (begin
-       (module-use! (module-public-interface (current-module))
-                    (resolve-interface '(mod ...)))
-       ...))))
-
-(re-export-modules (json builder)
-                   (json parser))
+  #:use-module ((minecraft json) #:prefix native:)
+  #:export (json->scm
+            json-string->scm
+            scm->json
+            scm->json-string))
+
+(define json-string->scm native:json-string->scm)
+
+(define* (json->scm #:optional (port (current-input-port)))
+  "Parse one JSON value from @var{port}, leaving whatever follows it unread."
+  (native:json-read port))
+
+(define* (scm->json scm
+                    #:optional (port (current-output-port))
+                    #:key (escape #f) (pretty #f))
+  "Write native value @var{scm} to @var{port} as a JSON document."
+  (native:scm->json scm port escape pretty))
+
+(define* (scm->json-string scm #:key (escape #f) (pretty #f))
+  "Build a JSON document from native value @var{scm}."
+  (native:scm->json-string scm escape pretty))
 
 ;;; (json) ends here
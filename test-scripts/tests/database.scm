@@ -1,5 +1,8 @@
 (define-module (tests database)
                #:use-module (minecraft)
+               #:use-module (minecraft command)
+               #:use-module (minecraft player-data)
+               #:use-module (minecraft storage)
 
                #:use-module (sqlite3))
 
@@ -20,4 +23,39 @@
 (let [(stmt (sqlite-prepare memdb "SELECT * FROM TEST;"))]
       (log-debug "SQLITE" "~a" (sqlite-map identity stmt)))
 
-(sqlite-close memdb)
\ No newline at end of file
+(sqlite-close memdb)
+
+(define store (storage-open "test-storage.db"))
+
+(storage-set! store "counter" (+ 1 (storage-ref store "counter" 0)))
+(storage-set! store "blob" #vu8(1 2 3))
+(storage-execute! store "CREATE TABLE IF NOT EXISTS visits(name TEXT, tick INTEGER);")
+(storage-execute! store "INSERT INTO visits VALUES(?, ?);" "test" 42)
+(storage-flush store)
+(log-debug "STORAGE" "~a ~a ~a" (storage-ref store "counter") (storage-ref store "blob") (storage-query store "SELECT * FROM visits WHERE tick = ?;" 42))
+(storage-close store)
+
+; Round trip: write a field, reopen the store (reloading online players from disk) and compare
+(player-data-open "test-player-data.db")
+
+(define player-data-expected #f)
+
+(add-hook! player-data-loaded
+           (lambda (player)
+                   (when player-data-expected
+                         (let [(actual (player-data-ref player "test-token"))]
+                              (if (equal? actual player-data-expected)
+                                  (log-debug "PLAYER-DATA" "round trip ok: ~a" actual)
+                                  (log-error "PLAYER-DATA" "round trip failed: expected ~a got ~a" player-data-expected actual))
+                              (set! player-data-expected #f)))))
+
+(reg-simple-command "test-player-data"
+                    "Test player data round trip"
+                    0
+                    (checked-player! player
+                                     (let [(token (number->string (random 1000000000 (random-state-from-platform))))]
+                                          (player-data-set! player "test-token" token)
+                                          (player-data-flush)
+                                          (set! player-data-expected token)
+                                          (player-data-open "test-player-data.db")
+                                          (outp-success))))